@@ -3,6 +3,8 @@
 #define NBMPI_ASTAR_HPP
 
 #include "utils.hpp"
+#include "cut_tree.hpp"
+#include "lb_weights.hpp"
 
 #include <set>
 #include <forward_list>
@@ -30,8 +32,10 @@ public:
     NodeLBDecision decision;          // Y / N boolean
     Probe stats;
     Time concrete_cost = 0.0;      // estimated cost to the solution
+    Time heuristic = 0.0;          // lower bound of the cost from the end of the node to the last iteration
 
-    Zoltan_Struct* lb;
+    partitioning::PartitionPtr partition;   // shared with the parent until the node balances
+    std::shared_ptr<const WeightHistory> weight_history;  // smoothed LB weights, shared with the parent until the node balances
 
     void set_cost(Time ncost) {
         this->node_cost = ncost;
@@ -46,6 +50,11 @@ public:
         return concrete_cost;
     }
 
+    /* cost of the path up to the node plus the lower bound of the remaining cost, the priority of the node */
+    inline Time estimated_cost() const {
+        return concrete_cost + heuristic;
+    }
+
     NodeLBDecision get_decision() const {
         return decision;
     }
@@ -55,41 +64,26 @@ public:
     }
 
     Node (Index id, int startit, int batch_size, NodeLBDecision decision, Probe stats, std::shared_ptr<Node> p) :
-        id(id),
-        start_it(startit), end_it(startit+batch_size), batch_size(batch_size), li_slowdown_hist(batch_size), dec_hist(batch_size), time_hist(batch_size),
-        parent(p), decision(decision), stats(stats), lb(Zoltan_Copy(parent->lb)),
-        concrete_cost(parent->concrete_cost){
-        int size;
-        MPI_Comm_size(MPI_COMM_WORLD, &size);
-        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    };
-
-    Node(Zoltan_Struct* zz, int batch_size) :
-            id(0),
-            start_it(0), end_it(batch_size), batch_size(batch_size), li_slowdown_hist(batch_size), dec_hist(batch_size), time_hist(batch_size), parent(nullptr),
-            decision(NodeLBDecision::DoLB),
-            lb(Zoltan_Copy(zz)), stats(0) {
-        int size;
-        MPI_Comm_size(MPI_COMM_WORLD, &size);
-        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-        stats = Probe(size);
-    }
-
-    Node(Zoltan_Struct* zz, int start_it, int batch_size, NodeLBDecision decision) :
-            id(0),
-            start_it(start_it), end_it(start_it+batch_size), batch_size(batch_size), li_slowdown_hist(batch_size), dec_hist(batch_size), time_hist(batch_size), parent(nullptr),
-            decision(decision),
-            lb(Zoltan_Copy(zz)), stats(0) {
+        start_it(startit), end_it(startit+batch_size), batch_size(batch_size), rank(p->rank), id(id),
+        parent(p), li_slowdown_hist(batch_size), dec_hist(batch_size), time_hist(batch_size),
+        decision(decision), stats(stats), concrete_cost(parent->concrete_cost),
+        partition(parent->partition), weight_history(parent->weight_history) {};
+
+    /* root of a search running on comm, the rank and the probe are those of comm */
+    Node(partitioning::PartitionPtr partition, int batch_size, MPI_Comm comm) :
+            Node(std::move(partition), 0, batch_size, NodeLBDecision::DoLB, comm) {}
+
+    Node(partitioning::PartitionPtr partition, int start_it, int batch_size, NodeLBDecision decision, MPI_Comm comm) :
+            start_it(start_it), end_it(start_it+batch_size), batch_size(batch_size), id(0),
+            parent(nullptr), li_slowdown_hist(batch_size), dec_hist(batch_size), time_hist(batch_size),
+            decision(decision), stats(0),
+            partition(std::move(partition)) {
         int size;
-        MPI_Comm_size(MPI_COMM_WORLD, &size);
-        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(comm, &size);
+        MPI_Comm_rank(comm, &rank);
         stats = Probe(size);
     }
 
-    ~Node() {
-        Zoltan_Destroy(&lb);
-    }
-
     std::array<std::shared_ptr<Node>, 2> get_children() {
         if(this->end_it == 0){
             return {
@@ -120,19 +114,20 @@ class Compare
 {
 public:
     bool operator() (std::shared_ptr<Node> a, std::shared_ptr<Node> b) const {
-        return a->cost() < b->cost();
+        return a->estimated_cost() < b->estimated_cost();
     }
 };
 
 template<typename MESH_DATA>
 bool operator<(const std::shared_ptr<Node> &n1, const std::shared_ptr<Node> &n2) {
-    return n1->cost() < n2->cost();
+    return n1->estimated_cost() < n2->estimated_cost();
 }
 
 std::ostream &operator <<(std::ostream& output, const std::shared_ptr<Node>& value)
 {
     output << " Iteration: " << std::setw(6) << value->start_it <<  " -> " << std::setw(6) << value->end_it;
     output << " Edge Cost: " << std::setw(6) << std::fixed << std::setprecision(5) << value->get_node_cost();
+    output << " Bound: " << std::setw(6) << std::fixed << std::setprecision(5) << value->heuristic;
     output << " Features: (";
     output << value->get_sequence() << " )";
     return output;
@@ -152,6 +147,57 @@ void prune_similar_nodes(const std::shared_ptr<Node>& n, Container& c){
     }
 }
 
+/**
+ * Bound of the remaining cost of a node: an iteration cannot take less than when it is perfectly balanced, so the
+ * remaining iterations times the shortest average (sum over the PEs / PEs) iteration time seen so far.
+ * The particles are never created nor destroyed, so the bound stays admissible as long as the work of an iteration
+ * does not fall below the lowest one observed; it only decreases during the search, the queue is then reordered.
+ */
+struct RemainingCostBound {
+    Time best_it_time = std::numeric_limits<Time>::max();
+    Real weight;   // 0: uniform cost search, above 1 the bound is no longer admissible
+    int nb_iterations;
+
+    RemainingCostBound(int nb_iterations, Real weight) : weight(weight), nb_iterations(nb_iterations) {}
+
+    /* @return whether the bound decreased, the nodes in the queue must then be ordered again */
+    bool update(Time avg_it_time) {
+        if (avg_it_time >= best_it_time) return false;
+        best_it_time = avg_it_time;
+        return true;
+    }
+
+    Time operator()(const Node& node) const {
+        const int remaining = std::max(0, nb_iterations - node.end_it);
+        return remaining && weight > 0 ? weight * remaining * best_it_time : 0.0;
+    }
+};
+
+/* set the bound of every node again and restore the order of the queue */
+template<class Container, class Bound>
+void update_heuristics(Container& c, const Bound& bound) {
+    Container updated;
+    for (const auto& node : c) {
+        node->heuristic = bound(*node);
+        updated.insert(node);
+    }
+    c.swap(updated);
+}
+
+/* Counters of a search */
+struct SearchStatistics {
+    Integer expanded = 0, simulated = 0, pruned = 0, skipped = 0, reordered = 0;
+    size_t max_queue_size = 0;
+};
+
+std::ostream &operator <<(std::ostream& output, const SearchStatistics& s)
+{
+    output << "A* statistics: " << s.expanded << " nodes expanded, " << s.simulated << " simulated, "
+           << s.pruned << " pruned, " << s.skipped << " LB children skipped, queue peak " << s.max_queue_size
+           << ", reordered " << s.reordered << " times";
+    return output;
+}
+
 bool has_been_explored(const std::multiset<std::shared_ptr<Node>, Compare>& c, std::shared_ptr<Node> target) {
     return std::any_of(c.cbegin(), c.cend(), [target](auto node){return node->start_it >= target->start_it;});
 }
@@ -0,0 +1,136 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_CELL_LISTS_HPP
+#define NBMPI_CELL_LISTS_HPP
+
+#include "utils.hpp"
+
+#include <array>
+#include <vector>
+
+enum CellListBackend {LinkedCells=0, CompressedCells=1};
+
+namespace algorithm {
+
+    /**
+     * Binning of the particles of a bounding box into cells of width rc. The local particles are binned first
+     * (indices [0, n_local)), the ghosts may be appended later (indices n_local and beyond), e.g. once the halo has
+     * arrived.
+     * LinkedCells:     one linked list per cell (head, lscl), built by CLL_init/CLL_update.
+     * CompressedCells: counting sort of the particle indices by cell (cell_start, cell_count = next start - start),
+     *                  one array for the locals and one for the ghosts, so the content of a cell is contiguous.
+     * Consumers only go through empty, count, for_each and for_each_pair, which work with both backends.
+     */
+    template<int N>
+    class CellLists {
+        CellListBackend backend;
+        BoundingBox<N> bbox;
+        Real rc = 0;
+        std::array<Integer, N> lc;
+        Integer n_cells = 0, n_local = 0, n_total = 0;
+
+        std::vector<Integer> head, lscl;
+        std::vector<Integer> local_start, local_items, ghost_start, ghost_items, cell_of;
+
+        template<class T, class GetPosFunc>
+        void counting_sort(const T* elements, Integer n, GetPosFunc getPosFunc, Integer first,
+                           std::vector<Integer>* start, std::vector<Integer>* items) {
+            cell_of.resize(n);
+            start->assign(n_cells + 1, 0);
+            for (Integer i = 0; i < n; ++i) {
+                cell_of[i] = position_to_local_cell_index<N>(*getPosFunc(const_cast<T&>(elements[i])), rc, bbox, lc[0], lc[1]);
+                (*start)[cell_of[i] + 1]++;
+            }
+            for (Integer c = 0; c < n_cells; ++c) (*start)[c + 1] += (*start)[c];
+            items->resize(n);
+            for (Integer i = 0; i < n; ++i) (*items)[(*start)[cell_of[i]]++] = first + i;
+            // the fill moved every start to the start of the next cell
+            for (Integer c = n_cells; c > 0; --c) (*start)[c] = (*start)[c - 1];
+            (*start)[0] = 0;
+        }
+
+    public:
+        explicit CellLists(int backend = LinkedCells) : backend(static_cast<CellListBackend>(backend)) {}
+
+        CellListBackend get_backend() const { return backend; }
+        Integer size() const { return n_cells; }
+        Integer nb_local() const { return n_local; }
+        Integer nb_elements() const { return n_total; }
+
+        /* bin the n local elements, any previous content (ghosts included) is discarded */
+        template<class T, class GetPosFunc>
+        void build(const T* elements, Integer n, GetPosFunc getPosFunc, const BoundingBox<N>& bbox, Real rc) {
+            this->bbox = bbox;
+            this->rc = rc;
+            lc = get_cell_number_by_dimension<N>(bbox, rc);
+            n_cells = get_total_cell_number<N>(bbox, rc);
+            n_local = n_total = n;
+            if (backend == LinkedCells) {
+                if ((Integer) head.size() < n_cells) head.resize(n_cells);
+                if ((Integer) lscl.size() < n) lscl.resize(n);
+                CLL_init<N, T>({{const_cast<T*>(elements), (size_t) n}}, getPosFunc, bbox, rc, &head, &lscl);
+            } else {
+                counting_sort(elements, n, getPosFunc, 0, &local_start, &local_items);
+                ghost_start.assign(n_cells + 1, 0);
+                ghost_items.clear();
+            }
+        }
+
+        /* bin the n ghosts after the local elements */
+        template<class G, class GetPosFunc>
+        void append(const G* ghosts, Integer n, GetPosFunc getPosFunc) {
+            if (backend == LinkedCells) {
+                if ((Integer) lscl.size() < n_local + n) lscl.resize(n_local + n);
+                CLL_update<N, G>({{const_cast<G*>(ghosts), (size_t) n}}, getPosFunc, bbox, rc, &head, &lscl, n_local);
+            } else {
+                counting_sort(ghosts, n, getPosFunc, n_local, &ghost_start, &ghost_items);
+            }
+            n_total = n_local + n;
+        }
+
+        bool empty(Integer c) const {
+            if (backend == LinkedCells) return head[c] == EMPTY;
+            return local_start[c] == local_start[c + 1] && ghost_start[c] == ghost_start[c + 1];
+        }
+
+        Integer count(Integer c) const {
+            if (backend == CompressedCells)
+                return local_start[c + 1] - local_start[c] + ghost_start[c + 1] - ghost_start[c];
+            Integer cnt = 0;
+            for (Integer i = head[c]; i != EMPTY; i = lscl[i]) cnt++;
+            return cnt;
+        }
+
+        /* f(j) for every particle j of the cell */
+        template<class F>
+        inline void for_each(Integer c, F f) const {
+            if (backend == LinkedCells) {
+                for (Integer i = head[c]; i != EMPTY; i = lscl[i]) f(i);
+            } else {
+                for (Integer k = local_start[c]; k < local_start[c + 1]; ++k) f(local_items[k]);
+                for (Integer k = ghost_start[c]; k < ghost_start[c + 1]; ++k) f(ghost_items[k]);
+            }
+        }
+
+        /* f(i, j) once for every pair of distinct particles of the cell */
+        template<class F>
+        inline void for_each_pair(Integer c, F f) const {
+            if (backend == LinkedCells) {
+                for (Integer i = head[c]; i != EMPTY; i = lscl[i])
+                    for (Integer j = lscl[i]; j != EMPTY; j = lscl[j]) f(i, j);
+            } else {
+                const Integer nl = local_start[c + 1] - local_start[c], n = nl + ghost_start[c + 1] - ghost_start[c];
+                const Integer* locals = local_items.data() + local_start[c];
+                const Integer* ghosts = ghost_items.data() + ghost_start[c];
+                auto item = [&](Integer a) { return a < nl ? locals[a] : ghosts[a - nl]; };
+                for (Integer a = 0; a < n; ++a) {
+                    const Integer i = item(a);
+                    for (Integer b = a + 1; b < n; ++b) f(i, item(b));
+                }
+            }
+        }
+    };
+}
+#endif //NBMPI_CELL_LISTS_HPP
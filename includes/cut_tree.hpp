@@ -0,0 +1,200 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_CUT_TREE_HPP
+#define NBMPI_CUT_TREE_HPP
+
+#include <zoltan.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace partitioning {
+
+    /**
+     * The cuts of a recursive coordinate bisection, enough to assign points and boxes to the parts without the
+     * Zoltan structure that computed them. The tree is rebuilt from the box of every part: the boxes of a set of
+     * parts are always separated by a plane that no box crosses. A point on a cut goes to the lower side.
+     *
+     * The nodes are stored flat, the cuts first then one node per part. A part node is a cut that leads to itself
+     * whatever the point, so every point can go down the same number of levels without testing for the leaves.
+     */
+    class CutTree {
+        using Box = std::array<double, 6>;  // min x y z, max x y z
+
+        std::vector<int> dims;
+        std::vector<double> values;
+        std::vector<std::array<int, 2>> next;   // lower side, upper side
+        int nb_cuts = 0, nb_parts = 0, depth = 0;
+
+        int add_cut(int dim, double value) {
+            dims.push_back(dim);
+            values.push_back(value);
+            next.push_back({0, 0});
+            return nb_cuts++;
+        }
+
+        /* @return the node of the parts [first, last), < 0 for a part: -(part + 1) */
+        int build(std::vector<int>::iterator first, std::vector<int>::iterator last, const std::vector<Box>& boxes, int ndim, int level) {
+            const auto n = std::distance(first, last);
+            if (n == 1) return -(*first + 1);
+            depth = std::max(depth, level + 1);
+            std::vector<double> lowest_min(n);
+            auto by_max = [&](int dim) {
+                std::sort(first, last, [&](int a, int b) { return boxes[a][3 + dim] < boxes[b][3 + dim]; });
+            };
+            // the most even cut keeps the tree shallow: the parts up to the k-th highest max are separated from the
+            // others when no other box starts below that max
+            int best_dim = -1;
+            std::ptrdiff_t best_k = 0;
+            for (int dim = 0; dim < ndim; ++dim) {
+                by_max(dim);
+                lowest_min[n - 1] = boxes[*(last - 1)][dim];
+                for (auto k = n - 2; k >= 0; --k) lowest_min[k] = std::min(lowest_min[k + 1], boxes[*(first + k)][dim]);
+                for (std::ptrdiff_t k = 0; k + 1 < n; ++k) {
+                    const double value = boxes[*(first + k)][3 + dim];
+                    const bool separates = boxes[*(first + k + 1)][3 + dim] > value && lowest_min[k + 1] >= value;
+                    if (separates && (best_dim < 0 || std::abs(2 * (k + 1) - n) < std::abs(2 * (best_k + 1) - n))) {
+                        best_dim = dim;
+                        best_k = k;
+                    }
+                }
+            }
+            if (best_dim < 0) throw std::runtime_error("CutTree: the parts are not a recursive bisection");
+            by_max(best_dim);
+            const int index = add_cut(best_dim, boxes[*(first + best_k)][3 + best_dim]);
+            const int lower = build(first, first + best_k + 1, boxes, ndim, level + 1);
+            const int upper = build(first + best_k + 1, last, boxes, ndim, level + 1);
+            next[index] = {lower, upper};
+            return index;
+        }
+
+        bool is_part(int node) const { return node >= nb_cuts; }
+
+        template<class F>
+        void visit_box(int node, const double* lo, const double* hi, F&& f) const {
+            while (!is_part(node)) {
+                const int dim = dims[node];
+                const bool lower = lo[dim] <= values[node], upper = hi[dim] >= values[node];
+                if (lower && upper) visit_box(next[node][1], lo, hi, f);
+                node = next[node][!lower];
+            }
+            f(node - nb_cuts);
+        }
+    public:
+        /* the cuts of the last partition computed by an RCB load balancer of nb_parts parts (KEEP_CUTS) */
+        static std::shared_ptr<const CutTree> from(Zoltan_Struct* zz, int nb_parts) {
+            auto tree = std::make_shared<CutTree>();
+            std::vector<Box> boxes(nb_parts);
+            int ndim = 3;
+            for (int part = 0; part < nb_parts; ++part) {
+                auto& b = boxes[part];
+                Zoltan_RCB_Box(zz, part, &ndim, &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+            }
+            std::vector<int> parts(nb_parts);
+            std::iota(parts.begin(), parts.end(), 0);
+            tree->build(parts.begin(), parts.end(), boxes, ndim, 0);
+            tree->nb_parts = nb_parts;
+            for (int part = 0; part < nb_parts; ++part) {
+                const int node = tree->nb_cuts + part;
+                tree->dims.push_back(0);
+                tree->values.push_back(std::numeric_limits<double>::infinity());
+                tree->next.push_back({node, node});
+            }
+            // the root is the first cut, or the only part
+            for (auto& children : tree->next)
+                for (auto& child : children) if (child < 0) child = tree->nb_cuts - child - 1;
+            return tree;
+        }
+
+        int get_nb_parts() const { return nb_parts; }
+        int get_depth() const { return depth; }
+
+        int point_assign(const double* x) const {
+            int node = 0;
+            while (!is_part(node)) node = next[node][!(x[dims[node]] <= values[node])];
+            return node - nb_cuts;
+        }
+
+        /**
+         * Part of n points at once, positionOf(k) being the position of the k-th point. The points go down the
+         * tree by blocks, all of them for depth levels, without branches nor early exit.
+         */
+        template<class PositionOf>
+        void point_assign(std::ptrdiff_t n, PositionOf positionOf, int* parts) const {
+            constexpr std::ptrdiff_t lanes = 16;
+            constexpr int N = std::tuple_size<std::decay_t<decltype(positionOf(0))>>::value;
+            const int*    dim   = dims.data();
+            const double* value = values.data();
+            const auto*   child = next.data();
+            double x[N][lanes];
+            int node[lanes];
+            for (std::ptrdiff_t first = 0; first < n; first += lanes) {
+                const std::ptrdiff_t m = std::min(lanes, n - first);
+                for (std::ptrdiff_t k = 0; k < m; ++k) {
+                    const auto& pos = positionOf(first + k);
+                    for (int d = 0; d < N; ++d) x[d][k] = pos[d];
+                    node[k] = 0;
+                }
+                for (int level = 0; level < depth; ++level)
+                    for (std::ptrdiff_t k = 0; k < m; ++k) {
+                        const int i = node[k];
+                        node[k] = child[i][!(x[dim[i]][k] <= value[i])];
+                    }
+                for (std::ptrdiff_t k = 0; k < m; ++k) parts[first + k] = node[k] - nb_cuts;
+            }
+        }
+
+        /* the parts whose domain intersects the box */
+        void box_assign(double x1, double y1, double z1, double x2, double y2, double z2, int* parts, int* nb_found) const {
+            const double lo[3] = {x1, y1, z1}, hi[3] = {x2, y2, z2};
+            *nb_found = 0;
+            visit_box(0, lo, hi, [&](int part) { parts[(*nb_found)++] = part; });
+        }
+    };
+
+    using PartitionPtr = std::shared_ptr<const CutTree>;
+}
+
+/* Point and box assignment, with a Zoltan load balancer or with a snapshot of its cuts */
+inline void point_assign(Zoltan_Struct* zz, double* x, int* part) {
+    Zoltan_LB_Point_Assign(zz, x, part);
+}
+inline void point_assign(const partitioning::CutTree* tree, double* x, int* part) {
+    *part = tree->point_assign(x);
+}
+inline void box_assign(Zoltan_Struct* zz, double x1, double y1, double z1, double x2, double y2, double z2, int* parts, int* nb_found) {
+    Zoltan_LB_Box_Assign(zz, x1, y1, z1, x2, y2, z2, parts, nb_found);
+}
+inline void box_assign(const partitioning::CutTree* tree, double x1, double y1, double z1, double x2, double y2, double z2, int* parts, int* nb_found) {
+    tree->box_assign(x1, y1, z1, x2, y2, z2, parts, nb_found);
+}
+
+/**
+ * Debug check of a snapshot: the number of the n points, positionOf(k) being the k-th, that the batched assignment
+ * on the tree sends to another part than the load balancer it was taken from.
+ */
+template<class LoadBalancer, class PositionOf>
+std::ptrdiff_t count_assignment_mismatches(LoadBalancer* LB, const partitioning::CutTree& tree, std::ptrdiff_t n, PositionOf positionOf) {
+    std::vector<int> parts(n);
+    tree.point_assign(n, positionOf, parts.data());
+    std::ptrdiff_t mismatches = 0;
+    for (std::ptrdiff_t k = 0; k < n; ++k) {
+        const auto& pos = positionOf(k);
+        double x[3] = {0, 0, 0};
+        std::copy(pos.cbegin(), pos.cend(), x);
+        int part;
+        point_assign(LB, x, &part);
+        mismatches += part != parts[k];
+    }
+    return mismatches;
+}
+#endif //NBMPI_CUT_TREE_HPP
@@ -6,9 +6,13 @@
 #define NBMPI_STRATEGY_HPP
 
 
+#include <cstdlib>
 #include <random>
 #include <queue>
+#include <map>
+#include <sstream>
 #include "../utils.hpp"
+#include "../params.hpp"
 
 namespace decision_making {
 
@@ -116,6 +120,187 @@ namespace decision_making {
         NoLBPolicy() {}
         bool apply(int it) { return false; }
     };
+
+    /**
+     * A policy requested on the command line: "name", "name:value[:value...]" or "name:key=value[:key=value...]",
+     * the values without a key are given to the parameters of the policy in order. Several specs are separated by
+     * commas.
+     */
+    struct PolicySpec {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> args;
+
+        static PolicySpec parse(const std::string& text) {
+            PolicySpec spec;
+            std::stringstream ss(text);
+            std::string token;
+            std::getline(ss, spec.name, ':');
+            while (std::getline(ss, token, ':')) {
+                const auto eq = token.find('=');
+                if (eq == std::string::npos) spec.args.emplace_back("", token);
+                else spec.args.emplace_back(token.substr(0, eq), token.substr(eq + 1));
+            }
+            return spec;
+        }
+
+        static std::vector<PolicySpec> parse_list(const std::string& text) {
+            std::vector<PolicySpec> specs;
+            std::stringstream ss(text);
+            std::string token;
+            while (std::getline(ss, token, ',')) if (!token.empty()) specs.push_back(parse(token));
+            return specs;
+        }
+
+        /* value of the parameter key, or of the unnamed one at position (from 0) when position >= 0 */
+        std::string get(const std::string& key, const std::string& default_value, int position = -1) const {
+            for (const auto& [k, v] : args) if (k == key) return v;
+            for (const auto& [k, v] : args) if (k.empty() && position-- == 0) return v;
+            return default_value;
+        }
+        Real get(const std::string& key, Real default_value, int position = -1) const {
+            const auto v = get(key, std::string(), position);
+            return v.empty() ? default_value : std::stof(v);
+        }
+        int get(const std::string& key, int default_value, int position = -1) const {
+            const auto v = get(key, std::string(), position);
+            return v.empty() ? default_value : std::stoi(v);
+        }
+
+        /* name used in the output files: the name followed by the parameter values */
+        std::string label() const {
+            std::string l = name;
+            for (const auto& arg : args) l += "-" + arg.second;
+            return l;
+        }
+    };
+
+    /* Policy built by the registry, the decision function owns whatever state the policy needs */
+    class RegisteredPolicy : public LBPolicy<RegisteredPolicy> {
+        std::function<bool ()> decide;
+    public:
+        explicit RegisteredPolicy(std::function<bool ()> decide) : decide(std::move(decide)) {}
+        bool should_load_balance() { return decide(); }
+    };
+
+    /**
+     * Named load balancing policies selectable at run time (--policy). A factory receives the probe of the run,
+     * which it may seed with prior load balancing costs (e.g. those measured by the A* search), and the spec.
+     */
+    class PolicyRegistry {
+    public:
+        struct Priors {
+            Time lb_time = 0;
+            Real lb_parallel_efficiency = 0;
+        };
+        using Factory = std::function<std::function<bool ()> (Probe*, const PolicySpec&, const sim_param_t&, const Priors&)>;
+    private:
+        std::map<std::string, Factory> factories;
+        std::map<std::string, bool> numeric_args;
+
+        static bool is_number(const std::string& value) {
+            char* end = nullptr;
+            std::strtod(value.c_str(), &end);
+            return !value.empty() && end == value.c_str() + value.size();
+        }
+    public:
+        void add(const std::string& name, Factory factory, bool numeric = true) {
+            factories[name] = std::move(factory);
+            numeric_args[name] = numeric;
+        }
+        bool contains(const std::string& name) const { return factories.count(name) > 0; }
+
+        /* empty if the spec can be made, otherwise why not: checked at startup rather than when the policy runs */
+        std::string validate(const PolicySpec& spec) const {
+            if (!contains(spec.name))
+                return "Unknown load balancing policy " + spec.name + ", available: " + names();
+            if (numeric_args.at(spec.name))
+                for (const auto& [k, v] : spec.args)
+                    if (!is_number(v)) return "Load balancing policy " + spec.name + ": '" + v + "' is not a number";
+            return std::string();
+        }
+
+        std::string names() const {
+            std::string l;
+            for (const auto& f : factories) l += (l.empty() ? "" : ", ") + f.first;
+            return l;
+        }
+
+        RegisteredPolicy make(const PolicySpec& spec, Probe* probe, const sim_param_t& params, const Priors& priors) const {
+            const auto it = factories.find(spec.name);
+            if (it == factories.cend())
+                throw std::runtime_error("Unknown load balancing policy '" + spec.name + "', available: " + names());
+            return RegisteredPolicy(it->second(probe, spec, params, priors));
+        }
+    };
+
+    /* Registry of the built-in policies */
+    inline PolicyRegistry& get_policy_registry() {
+        static PolicyRegistry registry = [] {
+            PolicyRegistry r;
+            // LB when the cumulative imbalance exceeds the average LB cost (Menon)
+            r.add("menon", [](Probe* probe, const PolicySpec&, const sim_param_t& params, const PolicyRegistry::Priors& priors) {
+                probe->push_load_balancing_time(priors.lb_time);
+                return std::function<bool ()>([probe, npframe = params.npframe]() {
+                    bool is_new_batch = (probe->get_current_iteration() % npframe == 0);
+                    bool is_cum_imb_higher_than_C = (probe->get_cumulative_imbalance_time() >= probe->compute_avg_lb_time());
+                    return is_new_batch && is_cum_imb_higher_than_C;
+                });
+            });
+            // LB when the estimated time of the next batch plus the LB cost is below ratio * the current one (Procassini)
+            r.add("procassini", [](Probe* probe, const PolicySpec& spec, const sim_param_t& params, const PolicyRegistry::Priors& priors) {
+                probe->push_load_balancing_time(priors.lb_time);
+                probe->push_load_balancing_parallel_efficiency(priors.lb_parallel_efficiency);
+                return std::function<bool ()>([probe, npframe = params.npframe, ratio = spec.get("ratio", 0.9f, 0)]() {
+                    bool is_new_batch = (probe->get_current_iteration() % npframe == 0);
+                    Real epsilon_c = probe->get_efficiency();
+                    Real epsilon_lb= probe->compute_avg_lb_parallel_efficiency(); //estimation based on previous lb call
+                    Real S         = epsilon_c / epsilon_lb;
+                    Real tau_prime = probe->batch_time *  S + probe->compute_avg_lb_time(); //estimation of next iteration time based on speed up + LB cost
+                    Real tau       = probe->batch_time;
+                    return is_new_batch && (tau_prime < ratio * tau);
+                });
+            });
+            // LB when an iteration time leaves the band average +/- threshold (Marquez)
+            r.add("marquez", [](Probe* probe, const PolicySpec& spec, const sim_param_t& params, const PolicyRegistry::Priors&) {
+                return std::function<bool ()>([probe, npframe = params.npframe, threshold = spec.get("threshold", 0.1f, 0)]() {
+                    bool is_new_batch = (probe->get_current_iteration() % npframe == 0);
+                    Real tolerance      = probe->get_avg_it() * threshold;
+                    Real tolerance_plus = probe->get_avg_it() + tolerance;
+                    Real tolerance_minus= probe->get_avg_it() - tolerance;
+                    return is_new_batch && (probe->get_min_it() < tolerance_minus || tolerance_plus < probe->get_max_it());
+                });
+            });
+            // LB when the cumulative imbalance time reaches a fixed value
+            r.add("threshold", [](Probe* probe, const PolicySpec& spec, const sim_param_t&, const PolicyRegistry::Priors&) {
+                auto p = std::make_shared<ThresholdPolicy>(probe,
+                        [](Probe* probe) { return (Real) probe->get_cumulative_imbalance_time(); },
+                        [value = spec.get("imbalance", 0.0f, 0)](Probe*) { return value; });
+                return std::function<bool ()>([p]() { return p->apply(); });
+            });
+            // LB every period iterations (one frame by default)
+            r.add("periodic", [](Probe* probe, const PolicySpec& spec, const sim_param_t& params, const PolicyRegistry::Priors&) {
+                auto p = std::make_shared<PeriodicPolicy>(spec.get("period", params.npframe, 0));
+                return std::function<bool ()>([p, probe]() { return p->apply(probe->get_current_iteration()); });
+            });
+            // LB with probability p at every iteration, the seed must be the same on every PE
+            r.add("random", [](Probe*, const PolicySpec& spec, const sim_param_t& params, const PolicyRegistry::Priors&) {
+                auto p = std::make_shared<RandomPolicy>(spec.get("p", 0.01f, 0), spec.get("seed", params.seed, 1));
+                return std::function<bool ()>([p]() { return p->apply(); });
+            });
+            // decisions of each frame read from a file
+            r.add("file", [](Probe* probe, const PolicySpec& spec, const sim_param_t& params, const PolicyRegistry::Priors&) {
+                auto p = std::make_shared<InFilePolicy>(probe, spec.get("name", std::string(), 0), params.nframes, params.npframe);
+                return std::function<bool ()>([p]() { return p->apply(); });
+            }, false);
+            // never LB
+            r.add("none", [](Probe* probe, const PolicySpec&, const sim_param_t&, const PolicyRegistry::Priors&) {
+                auto p = std::make_shared<NoLBPolicy>();
+                return std::function<bool ()>([p, probe]() { return p->apply(probe->get_current_iteration()); });
+            });
+            return r;
+        }();
+        return registry;
+    }
 } // end of namespace decision_making
 
 #endif //NBMPI_STRATEGY_HPP
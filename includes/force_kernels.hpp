@@ -0,0 +1,509 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_FORCE_KERNELS_HPP
+#define NBMPI_FORCE_KERNELS_HPP
+
+#include "utils.hpp"
+#include "physics.hpp"
+#include "thread_pool.hpp"
+#include "particle_store.hpp"
+#include "cell_lists.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NBMPI_X86_SIMD 1
+#endif
+
+enum ForceKernel {GenericKernel=0, BatchedLJKernel=1};
+enum ForceShell  {FullShell=0, HalfShell=1};
+
+namespace algorithm {
+namespace simd {
+
+    enum class ISA {Scalar, AVX2, AVX512};
+
+    inline const char* to_string(ISA isa) {
+        switch (isa) {
+            case ISA::AVX512: return "AVX-512";
+            case ISA::AVX2:   return "AVX2";
+            default:          return "Scalar";
+        }
+    }
+
+    /**
+     * Lennard-Jones force exerted by n sources on a receiver, one lane per pair.
+     * Lanes beyond the cut-off (or on top of the receiver) get a zero force.
+     * @param xi, yi, zi receiver position
+     * @param xs, ys, zs source positions (contiguous lanes)
+     * @param fx, fy, fz per-lane force, written
+     */
+    inline void lj_pair_forces_scalar(Real xi, Real yi, Real zi,
+                                      const Real* xs, const Real* ys, const Real* zs, Integer n,
+                                      Real eps, Real sig2,
+                                      Real* fx, Real* fy, Real* fz) {
+        for (Integer k = 0; k < n; ++k) {
+            const Real dx = xi - xs[k], dy = yi - ys[k], dz = zi - zs[k];
+            const Real r2 = dx*dx + dy*dy + dz*dz;
+            const Real C_LJ = r2 > 0 ? compute_LJ_scalar(r2, eps, sig2) : 0;
+            fx[k] = C_LJ * dx;
+            fy[k] = C_LJ * dy;
+            fz[k] = C_LJ * dz;
+        }
+    }
+
+#ifdef NBMPI_X86_SIMD
+    __attribute__((target("avx2,fma")))
+    inline void lj_pair_forces_avx2(Real xi, Real yi, Real zi,
+                                    const Real* xs, const Real* ys, const Real* zs, Integer n,
+                                    Real eps, Real sig2,
+                                    Real* fx, Real* fy, Real* fz) {
+        const __m256 vxi = _mm256_set1_ps(xi), vyi = _mm256_set1_ps(yi), vzi = _mm256_set1_ps(zi);
+        const __m256 vsig2 = _mm256_set1_ps(sig2), vcut2 = _mm256_set1_ps(6.25f * sig2);
+        const __m256 v24eps = _mm256_set1_ps(24.0f * eps), one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+        const __m256 zero = _mm256_setzero_ps();
+        Integer k = 0;
+        for (; k + 8 <= n; k += 8) {
+            const __m256 dx = _mm256_sub_ps(vxi, _mm256_loadu_ps(xs + k));
+            const __m256 dy = _mm256_sub_ps(vyi, _mm256_loadu_ps(ys + k));
+            const __m256 dz = _mm256_sub_ps(vzi, _mm256_loadu_ps(zs + k));
+            const __m256 r2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+            const __m256 in_range = _mm256_and_ps(_mm256_cmp_ps(r2, vcut2, _CMP_LT_OQ), _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+            const __m256 z = _mm256_div_ps(vsig2, r2);
+            const __m256 u = _mm256_mul_ps(z, _mm256_mul_ps(z, z));
+            __m256 c = _mm256_mul_ps(_mm256_div_ps(v24eps, r2), _mm256_mul_ps(u, _mm256_fnmadd_ps(two, u, one)));
+            c = _mm256_and_ps(c, in_range);
+            _mm256_storeu_ps(fx + k, _mm256_mul_ps(c, dx));
+            _mm256_storeu_ps(fy + k, _mm256_mul_ps(c, dy));
+            _mm256_storeu_ps(fz + k, _mm256_mul_ps(c, dz));
+        }
+        lj_pair_forces_scalar(xi, yi, zi, xs + k, ys + k, zs + k, n - k, eps, sig2, fx + k, fy + k, fz + k);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void lj_pair_forces_avx512(Real xi, Real yi, Real zi,
+                                      const Real* xs, const Real* ys, const Real* zs, Integer n,
+                                      Real eps, Real sig2,
+                                      Real* fx, Real* fy, Real* fz) {
+        const __m512 vxi = _mm512_set1_ps(xi), vyi = _mm512_set1_ps(yi), vzi = _mm512_set1_ps(zi);
+        const __m512 vsig2 = _mm512_set1_ps(sig2), vcut2 = _mm512_set1_ps(6.25f * sig2);
+        const __m512 v24eps = _mm512_set1_ps(24.0f * eps), one = _mm512_set1_ps(1.0f), two = _mm512_set1_ps(2.0f);
+        const __m512 zero = _mm512_setzero_ps();
+        Integer k = 0;
+        for (; k + 16 <= n; k += 16) {
+            const __m512 dx = _mm512_sub_ps(vxi, _mm512_loadu_ps(xs + k));
+            const __m512 dy = _mm512_sub_ps(vyi, _mm512_loadu_ps(ys + k));
+            const __m512 dz = _mm512_sub_ps(vzi, _mm512_loadu_ps(zs + k));
+            const __m512 r2 = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+            const __mmask16 in_range = _mm512_cmp_ps_mask(r2, vcut2, _CMP_LT_OQ) & _mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ);
+            const __m512 z = _mm512_div_ps(vsig2, r2);
+            const __m512 u = _mm512_mul_ps(z, _mm512_mul_ps(z, z));
+            const __m512 c = _mm512_maskz_mul_ps(in_range, _mm512_div_ps(v24eps, r2), _mm512_mul_ps(u, _mm512_fnmadd_ps(two, u, one)));
+            _mm512_storeu_ps(fx + k, _mm512_mul_ps(c, dx));
+            _mm512_storeu_ps(fy + k, _mm512_mul_ps(c, dy));
+            _mm512_storeu_ps(fz + k, _mm512_mul_ps(c, dz));
+        }
+        lj_pair_forces_scalar(xi, yi, zi, xs + k, ys + k, zs + k, n - k, eps, sig2, fx + k, fy + k, fz + k);
+    }
+#endif
+
+    using LJPairForcesFunc = void (*)(Real, Real, Real, const Real*, const Real*, const Real*, Integer, Real, Real, Real*, Real*, Real*);
+
+    inline ISA detect_isa() {
+#ifdef NBMPI_X86_SIMD
+        if constexpr (std::is_same<Real, float>::value) {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return ISA::AVX512;
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return ISA::AVX2;
+        }
+#endif
+        return ISA::Scalar;
+    }
+
+    inline ISA get_isa() {
+        static const ISA isa = detect_isa();
+        return isa;
+    }
+
+    inline LJPairForcesFunc get_lj_pair_forces() {
+#ifdef NBMPI_X86_SIMD
+        switch (get_isa()) {
+            case ISA::AVX512: return lj_pair_forces_avx512;
+            case ISA::AVX2:   return lj_pair_forces_avx2;
+            default:          break;
+        }
+#endif
+        return lj_pair_forces_scalar;
+    }
+
+    /* contiguous x/y/z lanes of the neighbourhood of one cell */
+    struct PairLanes {
+        std::vector<Integer> j;
+        std::vector<Real> x, y, z, fx, fy, fz;
+
+        void clear() { j.clear(); }
+        Integer size() const { return j.size(); }
+
+        void resize() {
+            const auto n = j.size();
+            x.resize(n); y.resize(n); z.resize(n);
+            fx.resize(n); fy.resize(n); fz.resize(n);
+        }
+    };
+
+} // end of namespace simd
+
+    /* position of the j-th particle of the cell lists, the ghosts (type G) may be a position-only view of the locals */
+    template<class T, class G, class GetPositionFunc>
+    inline const std::array<Real, 3>& get_position3d(const T *elements, Integer n_elements, const G *remote_elements,
+                                                     Integer j, GetPositionFunc getPosFunc) {
+        return j < n_elements ? *getPosFunc(const_cast<T&>(elements[j])) : *getPosFunc(const_cast<G&>(remote_elements[j - n_elements]));
+    }
+
+    /* the 13 neighbouring cells (dx, dy, dz) that come after the own cell in lexicographic order */
+    constexpr std::array<std::array<Integer, 3>, 13> HALF_SHELL_STENCIL = {{
+        { 1, 0, 0},
+        {-1, 1, 0}, { 0, 1, 0}, { 1, 1, 0},
+        {-1,-1, 1}, { 0,-1, 1}, { 1,-1, 1},
+        {-1, 0, 1}, { 0, 0, 1}, { 1, 0, 1},
+        {-1, 1, 1}, { 0, 1, 1}, { 1, 1, 1}
+    }};
+
+    template<class F>
+    inline void for_each_half_shell_cell(Integer cx, Integer cy, Integer cz, const std::array<Integer, 3>& lc, F f) {
+        for (const auto& d : HALF_SHELL_STENCIL) {
+            const Integer x = cx + d[0], y = cy + d[1], z = cz + d[2];
+            if ((x < 0 || x >= lc[0]) || (y < 0 || y >= lc[1]) || (z < 0 || z >= lc[2])) continue;
+            f(x + lc[0] * y + lc[0] * lc[1] * z);
+        }
+    }
+
+    /**
+     * Scratch memory of the force kernels, kept by its owner from one step to the next like the communication
+     * buffers: the force buffer of every thread but the calling one and the lanes of every thread.
+     * A kernel called without workspace uses a temporary one.
+     */
+    struct ForceWorkspace {
+        std::vector<std::vector<Real>> thread_acc;
+        std::vector<simd::PairLanes>   thread_lanes;
+    };
+
+    /**
+     * Cells a cell-based force computation is restricted to. The forces of these cells are added to acc, which is not
+     * cleared, so that a step may be computed in several passes (e.g. interior cells while the halo is in flight,
+     * then the others). progress, if any, is called by the calling thread between chunks of cells.
+     * The kernels only count the local elements in their complexity when they run over all the cells.
+     */
+    struct CellSubset {
+        const std::vector<Integer>* cells;
+        std::function<void ()> progress;
+
+        Integer size() const { return cells->size(); }
+        Integer operator[](Integer k) const { return (*cells)[k]; }
+    };
+
+    /**
+     * Clears acc[0, n_values) and runs kernel(tid, acc_out, begin, end) over the items [0, n_items) on the thread pool.
+     * With owner_writes the kernel only writes the force slots of the items of its range so every thread writes in
+     * acc directly; otherwise each thread accumulates in a private buffer and the buffers are summed into acc after
+     * the force phase, hence no atomic is needed.
+     * With a subset, the items are the cells of the subset and acc is not cleared.
+     * @return the sum of the values returned by the kernel
+     */
+    template<class RangeKernel>
+    Integer parallel_accumulate_forces(std::vector<Real>* acc, Integer n_values, Integer n_items,
+                                       int nb_threads, bool owner_writes, RangeKernel kernel,
+                                       const CellSubset* subset = nullptr, ForceWorkspace* workspace = nullptr) {
+        const auto progress = subset ? subset->progress : std::function<void ()>();
+        if (!subset) std::fill(acc->begin(), acc->begin() + n_values, (Real) 0.0);
+        if (nb_threads <= 1) {
+            if (!progress) return kernel(0, acc->data(), 0, n_items);
+            constexpr Integer chunk = 64;
+            Integer cmplx = 0;
+            for (Integer begin = 0; begin < n_items; begin += chunk) {
+                cmplx += kernel(0, acc->data(), begin, std::min(begin + chunk, n_items));
+                progress();
+            }
+            return cmplx;
+        }
+
+        auto& pool = parallel::get_thread_pool(nb_threads);
+        std::vector<Integer> cmplx(pool.size(), 0);
+        ForceWorkspace temporary;
+        auto& thread_acc = (workspace ? workspace : &temporary)->thread_acc;
+        if (!owner_writes) {
+            thread_acc.resize(pool.size());
+            pool.run([&](int tid) { if (tid) thread_acc[tid].assign(n_values, (Real) 0.0); });
+        }
+        pool.parallel_for(0, n_items, pool.grain_for(n_items), [&](int tid, Integer begin, Integer end) {
+            Real* out = (owner_writes || !tid) ? acc->data() : thread_acc[tid].data();
+            cmplx[tid] += kernel(tid, out, begin, end);
+            if (!tid && progress) progress();
+        });
+        if (!owner_writes) {
+            pool.parallel_for(0, n_values, pool.grain_for(n_values), [&](int, Integer begin, Integer end) {
+                for (int t = 1; t < pool.size(); ++t) {
+                    const Real* buffer = thread_acc[t].data();
+                    for (Integer k = begin; k < end; ++k) (*acc)[k] += buffer[k];
+                }
+            });
+        }
+        return std::accumulate(cmplx.cbegin(), cmplx.cend(), (Integer) 0);
+    }
+
+    /**
+     * Newton's third law force computation with a generic pair functor: every pair of the own cell and of the 13
+     * half-shell cells is evaluated once, +F goes to the receiver and -F to the source. Pairs that involve a ghost
+     * are evaluated once as well (ghost-ghost pairs are skipped), only the local side keeps the force.
+     * The cells (all of them, or those of subset) are split among nb_threads threads, each one accumulating in its
+     * own force buffer.
+     * @return the number of interactions computed plus the number of local elements
+     */
+    template<class T, class G, class GetPositionFunc, class ComputeForceFunc>
+    Integer CLL_compute_forces3d_half_shell(std::vector<Real>* acc,
+                                            const T *elements, Integer n_elements,
+                                            const G *remote_elements,
+                                            GetPositionFunc /* getPosFunc */,
+                                            const BoundingBox<3>& bbox, Real rc,
+                                            const CellLists<3> *cells,
+                                            ComputeForceFunc computeForceFunc, int nb_threads = 1,
+                                            const CellSubset* subset = nullptr, ForceWorkspace* workspace = nullptr) {
+        const auto lc = get_cell_number_by_dimension<3>(bbox, rc);
+        const Integer n_cells = subset ? subset->size() : lc[0] * lc[1] * lc[2];
+
+        auto cell_range = [&](int, Real* a, Integer k_begin, Integer k_end) {
+            Integer cmplx = 0;
+            auto apply = [&](Integer i, Integer j) {
+                if (i >= n_elements && j >= n_elements) return;
+                auto force_on = [&](const auto& receiver) {
+                    return j < n_elements ? computeForceFunc(receiver, elements[j]) : computeForceFunc(receiver, remote_elements[j - n_elements]);
+                };
+                std::array<Real, 3> force = i < n_elements ? force_on(elements[i]) : force_on(remote_elements[i - n_elements]);
+                for (int dim = 0; dim < 3; ++dim) {
+                    if (i < n_elements) a[3*i + dim] += force[dim];
+                    if (j < n_elements) a[3*j + dim] -= force[dim];
+                }
+                cmplx++;
+            };
+            for (Integer k = k_begin; k < k_end; ++k) {
+                const Integer c = subset ? (*subset)[k] : k;
+                if (cells->empty(c)) continue;
+                const Integer cx = c % lc[0], cy = (c / lc[0]) % lc[1], cz = c / (lc[0] * lc[1]);
+                cells->for_each_pair(c, apply);
+                cells->for_each(c, [&](Integer i) {
+                    for_each_half_shell_cell(cx, cy, cz, lc, [&](Integer c1) {
+                        cells->for_each(c1, [&](Integer j) { apply(i, j); });
+                    });
+                });
+            }
+            return cmplx;
+        };
+        return (subset ? 0 : n_elements) + parallel_accumulate_forces(acc, 3 * n_elements, n_cells, nb_threads, false, cell_range, subset, workspace);
+    }
+
+    /**
+     * Batched Lennard-Jones force computation evaluated with the widest SIMD kernel the CPU supports.
+     * FullShell: for every cell holding local particles, the 27 neighbouring cells are gathered into contiguous
+     *            lanes once and every local receiver of the cell is evaluated against all of them.
+     * HalfShell: for every cell, the own cell followed by the 13 half-shell cells are gathered; the k-th particle of
+     *            the cell is evaluated against the lanes after k, +F goes to the receiver and -F to each local source.
+     * The cells are split among nb_threads threads; a full shell only writes the receivers of its cells and shares
+     * acc, a half shell accumulates in per-thread buffers. With a subset, only its cells are computed.
+     * @param positionOf j -> position of the j-th particle of the cell lists (locals first, then ghosts)
+     * @return the number of interactions computed plus the number of local elements
+     */
+    template<class PositionOf>
+    Integer CLL_compute_forces3d_batched(std::vector<Real>* acc,
+                                         Integer n_elements,
+                                         PositionOf positionOf,
+                                         const BoundingBox<3>& bbox, Real rc,
+                                         const CellLists<3> *cells,
+                                         Real eps, Real sig2, ForceShell shell, int nb_threads,
+                                         const CellSubset* subset, ForceWorkspace* workspace = nullptr) {
+        const auto lc = get_cell_number_by_dimension<3>(bbox, rc);
+        const Integer n_cells = subset ? subset->size() : lc[0] * lc[1] * lc[2];
+        const auto lj_pair_forces = simd::get_lj_pair_forces();
+        ForceWorkspace temporary;
+        if (!workspace) workspace = &temporary;
+        auto& thread_lanes = workspace->thread_lanes;
+        if (thread_lanes.size() < (size_t) std::max(1, nb_threads)) thread_lanes.resize(std::max(1, nb_threads));
+
+        auto cell_range = [&](int tid, Real* a, Integer k_begin, Integer k_end) {
+            auto& lanes = thread_lanes[tid];
+            Integer cmplx = 0;
+            auto load_lanes = [&]() {
+                lanes.resize();
+                for (Integer k = 0; k < lanes.size(); ++k) {
+                    const auto& pos = positionOf(lanes.j[k]);
+                    lanes.x[k] = pos[0]; lanes.y[k] = pos[1]; lanes.z[k] = pos[2];
+                }
+            };
+            auto evaluate = [&](Integer i, Integer first) {
+                const auto& pos = positionOf(i);
+                lj_pair_forces(pos[0], pos[1], pos[2],
+                               &lanes.x[first], &lanes.y[first], &lanes.z[first], lanes.size() - first, eps, sig2,
+                               &lanes.fx[first], &lanes.fy[first], &lanes.fz[first]);
+            };
+
+            for (Integer k = k_begin; k < k_end; ++k) {
+                const Integer c = subset ? (*subset)[k] : k;
+                if (cells->empty(c)) continue;
+                const Integer cx = c % lc[0], cy = (c / lc[0]) % lc[1], cz = c / (lc[0] * lc[1]);
+                lanes.clear();
+
+                if (shell == FullShell) {
+                    bool has_receiver = false;
+                    cells->for_each(c, [&](Integer i) { has_receiver |= i < n_elements; });
+                    if (!has_receiver) continue;
+
+                    for (Integer z = std::max((Integer) 0, cz - 1); z <= std::min(lc[2] - 1, cz + 1); ++z)
+                        for (Integer y = std::max((Integer) 0, cy - 1); y <= std::min(lc[1] - 1, cy + 1); ++y)
+                            for (Integer x = std::max((Integer) 0, cx - 1); x <= std::min(lc[0] - 1, cx + 1); ++x)
+                                cells->for_each(x + lc[0] * y + lc[0] * lc[1] * z, [&](Integer j) { lanes.j.push_back(j); });
+                    load_lanes();
+
+                    cells->for_each(c, [&](Integer i) {
+                        if (i >= n_elements) return;
+                        /* the receiver is one of the lanes, its own lane has r2 = 0 and yields no force */
+                        evaluate(i, 0);
+                        Real fx = 0, fy = 0, fz = 0;
+                        for (Integer k = 0; k < lanes.size(); ++k) {
+                            fx += lanes.fx[k]; fy += lanes.fy[k]; fz += lanes.fz[k];
+                        }
+                        a[3*i]   += fx;
+                        a[3*i+1] += fy;
+                        a[3*i+2] += fz;
+                        cmplx += lanes.size() - 1;
+                    });
+                } else {
+                    cells->for_each(c, [&](Integer i) { lanes.j.push_back(i); });
+                    const Integer n_own = lanes.size();
+                    for_each_half_shell_cell(cx, cy, cz, lc, [&](Integer c1) {
+                        cells->for_each(c1, [&](Integer j) { lanes.j.push_back(j); });
+                    });
+                    Integer last_local = -1;
+                    for (Integer k = 0; k < lanes.size(); ++k) if (lanes.j[k] < n_elements) last_local = k;
+                    if (last_local < 0) continue;
+                    load_lanes();
+
+                    for (Integer k = 0; k < n_own; ++k) {
+                        const Integer i = lanes.j[k], first = k + 1;
+                        /* ghost receiver with ghost-only sources */
+                        if (first >= lanes.size() || (i >= n_elements && first > last_local)) continue;
+                        evaluate(i, first);
+                        Real fx = 0, fy = 0, fz = 0;
+                        Integer local_sources = 0;
+                        for (Integer q = first; q < lanes.size(); ++q) {
+                            fx += lanes.fx[q]; fy += lanes.fy[q]; fz += lanes.fz[q];
+                            if (const Integer j = lanes.j[q]; j < n_elements) {
+                                a[3*j]   -= lanes.fx[q];
+                                a[3*j+1] -= lanes.fy[q];
+                                a[3*j+2] -= lanes.fz[q];
+                                local_sources++;
+                            }
+                        }
+                        if (i < n_elements) {
+                            a[3*i]   += fx;
+                            a[3*i+1] += fy;
+                            a[3*i+2] += fz;
+                        }
+                        /* the ghost-ghost lanes are computed with the others but, as in the other kernels, not counted */
+                        cmplx += i < n_elements ? lanes.size() - first : local_sources;
+                    }
+                }
+            }
+            return cmplx;
+        };
+        return (subset ? 0 : n_elements) + parallel_accumulate_forces(acc, 3 * n_elements, n_cells, nb_threads, shell == FullShell, cell_range, subset, workspace);
+    }
+
+    template<class T, class G, class GetPositionFunc>
+    Integer CLL_compute_forces3d_batched(std::vector<Real>* acc,
+                                         const T *elements, Integer n_elements,
+                                         const G *remote_elements,
+                                         GetPositionFunc getPosFunc,
+                                         const BoundingBox<3>& bbox, Real rc,
+                                         const CellLists<3> *cells,
+                                         Real eps, Real sig2, ForceShell shell, int nb_threads = 1,
+                                         const CellSubset* subset = nullptr, ForceWorkspace* workspace = nullptr) {
+        return CLL_compute_forces3d_batched(acc, n_elements, [&](Integer j) -> const std::array<Real, 3>& {
+            return get_position3d(elements, n_elements, remote_elements, j, getPosFunc);
+        }, bbox, rc, cells, eps, sig2, shell, nb_threads, subset, workspace);
+    }
+
+    template<int N, class T, class G, class GetPositionFunc>
+    Integer CLL_compute_forces_batched(std::vector<Real>* acc,
+                                       const std::vector<T>& loc_el,
+                                       const std::vector<G>& rem_el,
+                                       GetPositionFunc getPosFunc,
+                                       const BoundingBox<N>& bbox, Real rc,
+                                       const CellLists<N> *cells,
+                                       Real eps, Real sig2, ForceShell shell, int nb_threads = 1,
+                                       const CellSubset* subset = nullptr, ForceWorkspace* workspace = nullptr) {
+        if constexpr(N==3) {
+            return CLL_compute_forces3d_batched(acc, loc_el.data(), loc_el.size(), rem_el.data(), getPosFunc, bbox, rc, cells, eps, sig2, shell, nb_threads, subset, workspace);
+        } else {
+            return 0;
+        }
+    }
+
+    /* batched forces on a structure-of-arrays store holding the n_local local particles followed by the ghosts */
+    template<int N>
+    Integer CLL_compute_forces_batched(std::vector<Real>* acc,
+                                       const elements::ParticleStore<N>& store, Integer n_local,
+                                       const BoundingBox<N>& bbox, Real rc,
+                                       const CellLists<N> *cells,
+                                       Real eps, Real sig2, ForceShell shell, int nb_threads = 1,
+                                       const CellSubset* subset = nullptr, ForceWorkspace* workspace = nullptr) {
+        if constexpr(N==3) {
+            return CLL_compute_forces3d_batched(acc, n_local, [&store](Integer j) { return store.position(j); },
+                                                bbox, rc, cells, eps, sig2, shell, nb_threads, subset, workspace);
+        } else {
+            return 0;
+        }
+    }
+
+    template<int N, class T, class G, class GetPositionFunc, class ComputeForceFunc>
+    Integer CLL_compute_forces_half_shell(std::vector<Real>* acc,
+                                          const std::vector<T>& loc_el,
+                                          const std::vector<G>& rem_el,
+                                          GetPositionFunc getPosFunc,
+                                          const BoundingBox<N>& bbox, Real rc,
+                                          const CellLists<3> *cells,
+                                          ComputeForceFunc computeForceFunc, int nb_threads = 1,
+                                          const CellSubset* subset = nullptr, ForceWorkspace* workspace = nullptr) {
+        if constexpr(N==3) {
+            return CLL_compute_forces3d_half_shell(acc, loc_el.data(), loc_el.size(), rem_el.data(), getPosFunc, bbox, rc, cells, computeForceFunc, nb_threads, subset, workspace);
+        } else {
+            return 0;
+        }
+    }
+
+    /* CLL_compute_forces with the local receivers split among nb_threads threads */
+    template<int N, class T, class G, class GetPositionFunc, class ComputeForceFunc>
+    Integer CLL_compute_forces_full_shell(std::vector<Real>* acc,
+                                          const std::vector<T>& loc_el,
+                                          const std::vector<G>& rem_el,
+                                          GetPositionFunc getPosFunc,
+                                          const BoundingBox<N>& bbox, Real rc,
+                                          const CellLists<3> *cells,
+                                          ComputeForceFunc computeForceFunc, int nb_threads = 1) {
+        if constexpr(N==3) {
+            const Integer n_elements = loc_el.size();
+            return n_elements + parallel_accumulate_forces(acc, 3 * n_elements, n_elements, nb_threads, true,
+                    [&](int, Real* a, Integer begin, Integer end) {
+                        return CLL_compute_forces3d_range(a, loc_el.data(), n_elements, rem_el.data(), getPosFunc, bbox, rc, cells, computeForceFunc, begin, end);
+                    });
+        } else {
+            return 0;
+        }
+    }
+}
+#endif //NBMPI_FORCE_KERNELS_HPP
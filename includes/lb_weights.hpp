@@ -0,0 +1,84 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_LB_WEIGHTS_HPP
+#define NBMPI_LB_WEIGHTS_HPP
+
+#include "utils.hpp"
+#include "cell_lists.hpp"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/* smoothed weight of the elements (gid) at the last load balancing */
+using WeightHistory = std::unordered_map<Index, float>;
+
+enum LBWeighting {CountWeights=0, InteractionWeights=1, SmoothedInteractionWeights=2};
+
+/**
+ * Zoltan object weights of the local elements.
+ * CountWeights:               no weights, RCB balances the number of elements.
+ * InteractionWeights:         1 + the number of pairs the force kernel evaluates for the element, i.e. the number of
+ *                             elements (local or ghost) in its 27 neighbouring cells but itself.
+ * SmoothedInteractionWeights: exponential moving average of the interaction weights of the same element (gid) over
+ *                             the successive load balancing calls, so that a transient cluster does not drive the cuts.
+ *                             The history can be taken and given back, to follow another sequence of calls.
+ */
+template<int N>
+class ObjectWeights {
+    LBWeighting mode;
+    float alpha;
+    std::shared_ptr<const WeightHistory> previous;
+public:
+    explicit ObjectWeights(int mode, float alpha = 0.5f) : mode(static_cast<LBWeighting>(mode)), alpha(alpha) {}
+
+    std::shared_ptr<const WeightHistory> get_history() const { return previous; }
+    void set_history(std::shared_ptr<const WeightHistory> history) { previous = std::move(history); }
+
+    /**
+     * @param cells cell lists of the last step (locals first, then ghosts)
+     * @param weights one weight per element of els, cleared with CountWeights
+     */
+    template<class T>
+    void compute(const std::vector<T>& els,
+                 const BoundingBox<N>& bbox, Real rc,
+                 const algorithm::CellLists<N>* cells,
+                 std::vector<float>* weights) {
+        weights->clear();
+        if (mode == CountWeights) return;
+
+        const auto lc = get_cell_number_by_dimension<N>(bbox, rc);
+        const Integer n_cells = get_total_cell_number<N>(bbox, rc);
+        std::vector<Integer> occupancy(n_cells, 0);
+        for (Integer c = 0; c < n_cells; ++c) occupancy[c] = cells->count(c);
+
+        weights->assign(els.size(), 1.0f);
+        for (Integer c = 0; c < n_cells; ++c) {
+            if (cells->empty(c)) continue;
+            const Integer cx = c % lc[0], cy = (c / lc[0]) % lc[1], cz = N == 3 ? c / (lc[0] * lc[1]) : 0;
+            Integer neighbours = 0;
+            for (Integer z = std::max((Integer) 0, cz - 1); z <= (N == 3 ? std::min(lc[N-1] - 1, cz + 1) : 0); ++z)
+                for (Integer y = std::max((Integer) 0, cy - 1); y <= std::min(lc[1] - 1, cy + 1); ++y)
+                    for (Integer x = std::max((Integer) 0, cx - 1); x <= std::min(lc[0] - 1, cx + 1); ++x)
+                        neighbours += occupancy[x + lc[0] * y + lc[0] * lc[1] * z];
+            cells->for_each(c, [&](Integer i) {
+                if (i < (Integer) els.size()) (*weights)[i] = (float) neighbours;
+            });
+        }
+
+        if (mode == SmoothedInteractionWeights) {
+            auto current = std::make_shared<WeightHistory>();
+            current->reserve(els.size());
+            for (size_t i = 0; i < els.size(); ++i) {
+                auto& w = (*weights)[i];
+                if (previous)
+                    if (auto it = previous->find(els[i].gid); it != previous->end()) w = alpha * w + (1.0f - alpha) * it->second;
+                current->emplace(els[i].gid, w);
+            }
+            previous = std::move(current);
+        }
+    }
+};
+#endif //NBMPI_LB_WEIGHTS_HPP
@@ -15,49 +15,174 @@
 #include "physics.hpp"
 #include "utils.hpp"
 #include "parallel_utils.hpp"
+#include "force_kernels.hpp"
+#include "verlet_list.hpp"
 
 auto MPI_TIME       = MPI_DOUBLE;
 auto MPI_COMPLEXITY = MPI_LONG_LONG;
 
 namespace lj {
+    /**
+     * Scratch memory of compute_one_step, owned by the simulation loop and reused from one step to the next.
+     */
+    template<int N>
+    struct Workspace {
+        algorithm::ForceWorkspace forces;               // force buffers and lanes of the threads
+        std::vector<Integer> interior_cells, border_cells;
+        elements::ParticleStore<N> store;               // structure-of-arrays copy of the particles (SOA_PARTICLE_STORE)
+    };
+
     namespace {
         std::vector<Real> acc;
+
+        /**
+         * Forces of the interior cells while the halo is in flight (the calling thread progresses it between chunks of
+         * cells), then of the other cells once onGhosts has completed the exchange. Interior cells have no ghost
+         * neighbour (see is_interior_cell), so every pair is still computed exactly once.
+         */
+        template<int N, class T, class CellForcesFunc, class OnGhostsFunc>
+        Complexity compute_forces_overlapped(Integer nb_elements, const BoundingBox<N>& bbox, Real rc,
+                                             const algorithm::CellLists<N>* cells, SparseExchange<T>* halo,
+                                             Workspace<N>& workspace, CellForcesFunc cellForces, OnGhostsFunc onGhosts) {
+            std::fill(acc.begin(), acc.begin() + N * nb_elements, (Real) 0.0);
+            split_interior_cells<N>(bbox, rc, cells, &workspace.interior_cells, &workspace.border_cells);
+            Complexity cmplx = nb_elements + cellForces(algorithm::CellSubset{&workspace.interior_cells, [halo] { halo->progress(); }});
+            onGhosts();
+            return cmplx + cellForces(algorithm::CellSubset{&workspace.border_cells, nullptr});
+        }
+    }
+
+#ifdef SOA_PARTICLE_STORE
+    /**
+     * compute_one_step with the particles copied into a structure-of-arrays store (same order as the cell lists):
+     * forces and integration only stream the position/velocity arrays; positions and velocities are written back to
+     * the records at the end. The store is the one of the caller's workspace, its arrays are reused from one step to the next.
+     */
+    template<int N, class Integrator, class T, class G, class GetPosPtrFunc, class GetVelPtrFunc>
+    Complexity compute_one_step_soa (
+            std::vector<T>&        elements,
+            const std::vector<G>& remote_el,
+            GetPosPtrFunc getPosPtrFunc,
+            GetVelPtrFunc getVelPtrFunc,
+            algorithm::CellLists<N> *cells,
+            BoundingBox<N>& bbox,
+            const sim_param_t *params,
+            algorithm::VerletList<N>* verlet,
+            SparseExchange<G>* halo,
+            Workspace<N>& workspace) {
+
+        const Real cut_off_radius = params->rc;
+        const size_t nb_elements = elements.size();
+        const Real sig2 = params->sig_lj * params->sig_lj;
+        const auto shell = static_cast<ForceShell>(params->force_shell);
+        auto& store = workspace.store;
+        auto* forces = &workspace.forces;
+        Complexity cmplx;
+
+        auto finish_halo = [&]() {
+            finish_ghost_exchange<N>(*halo, remote_el, getPosPtrFunc, cells);
+            store.append_ghosts(remote_el, getPosPtrFunc);
+        };
+
+        if(halo && !verlet) {
+            store.clear();
+            store.append(elements, getPosPtrFunc, getVelPtrFunc);
+            cmplx = compute_forces_overlapped<N>(nb_elements, bbox, cut_off_radius, cells, halo, workspace, [&](const algorithm::CellSubset& subset) {
+                return algorithm::CLL_compute_forces_batched<N>(&acc, store, nb_elements, bbox, cut_off_radius, cells, params->eps_lj, sig2, shell, params->nb_threads, &subset, forces);
+            }, finish_halo);
+        } else if(verlet) {
+            store.clear();
+            store.append(elements, getPosPtrFunc, getVelPtrFunc);
+            if(halo) finish_halo();
+            else store.append_ghosts(remote_el, getPosPtrFunc);
+            if(!verlet->is_built())
+                verlet->build(store, nb_elements, bbox, cut_off_radius, cells, 2.5f * params->sig_lj);
+            cmplx = verlet->compute_forces(&acc, store, params->eps_lj, sig2, params->nb_threads);
+        } else {
+            store.load(elements, remote_el, getPosPtrFunc, getVelPtrFunc);
+            cmplx = algorithm::CLL_compute_forces_batched<N>(&acc, store, nb_elements, bbox, cut_off_radius, cells, params->eps_lj, sig2, shell, params->nb_threads, nullptr, forces);
+        }
+
+        const Integrator integrator(*params);
+        parallel::for_range(params->nb_threads, nb_elements, [&](size_t begin, size_t end) {
+            integrate<N>(integrator, acc, store, begin, end);
+        });
+
+        store.store(elements, getPosPtrFunc, getVelPtrFunc);
+        return cmplx;
     }
+#endif
 
-    template<int N, class T, class SetPosFunc, class SetVelFunc, class GetForceFunc>
+    /**
+     * One time step: forces of the local elements from the cell lists, then one sweep of Integrator over them
+     * (integrators::Leapfrog unless another one is given, e.g. compute_one_step<N, MyIntegrator>(...)).
+     */
+    template<int N, class Integrator = integrators::Leapfrog, class T, class G, class SetPosFunc, class SetVelFunc, class GetForceFunc>
     Complexity compute_one_step (
             std::vector<T>&        elements,
-            const std::vector<T>& remote_el,
+            const std::vector<G>& remote_el,           // ghosts, full records or positions only (elements::Ghost)
             SetPosFunc getPosPtrFunc,                  // function to get force of an entity
             SetVelFunc getVelPtrFunc,                  // function to get force of an entity
-            std::vector<Integer> *head,                // the cell starting point
-            std::vector<Integer> *lscl,                // the particle linked list
+            algorithm::CellLists<N> *cells,            // cell lists, elements then remote_el (built by get_ghost_data)
             BoundingBox<N>& bbox,                      // bounding box of particles
             GetForceFunc getForceFunc,                 // function to compute force between entities
-            const Borders& borders,                    // bordering cells and neighboring processors
-            const sim_param_t *params) {               // simulation parameters
+            [[maybe_unused]] const Borders& borders,   // bordering cells and neighboring processors
+            const sim_param_t *params,                 // simulation parameters
+            algorithm::VerletList<N>* verlet = nullptr, // neighbour lists reused between rebuilds, if any
+            SparseExchange<G>* halo = nullptr,         // ghost exchange in flight (start_ghost_exchange), if any
+            Workspace<N>* workspace = nullptr) {       // scratch memory of the caller, a temporary one if none
 
         const Real cut_off_radius = params->rc; // cut_off
-        const Real dt = params->dt;
         const size_t nb_elements = elements.size();
 
-        if(const auto n_cells = get_total_cell_number<N>(bbox, params->rc); head->size() < n_cells) {
-            head->resize(n_cells);
-        }
         if(const auto n_force_elements = N*elements.size(); acc.size() < n_force_elements) {
             acc.resize(N*n_force_elements);
         }
-        if(const auto n_particles = elements.size()+remote_el.size();  lscl->size() < n_particles) {
-            lscl->resize(n_particles);
-        }
 
-        algorithm::CLL_init<N, T>({ {elements.data(), nb_elements}, {elements.data(), remote_el.size()} }, getPosPtrFunc, bbox, cut_off_radius, head, lscl);
+        Workspace<N> temporary;
+        if(!workspace) workspace = &temporary;
+        auto* forces = &workspace->forces;
+
+#ifdef SOA_PARTICLE_STORE
+        // the Lennard-Jones kernels run on the structure-of-arrays store, the generic functor needs element records
+        if(verlet || params->force_kernel == BatchedLJKernel)
+            return compute_one_step_soa<N, Integrator, T, G>(elements, remote_el, getPosPtrFunc, getVelPtrFunc, cells, bbox, params, verlet, halo, *workspace);
+#endif
+
+        const Real sig2 = params->sig_lj * params->sig_lj;
+        const auto shell = static_cast<ForceShell>(params->force_shell);
+        Complexity cmplx;
+
+        // the cell-based kernels start with the interior cells while the halo is in flight, the Verlet lists and the
+        // full-shell functor kernel need every ghost before they start
+        const bool overlap = halo && !verlet && (params->force_kernel == BatchedLJKernel || shell == HalfShell);
+        if(halo && !overlap)
+            finish_ghost_exchange<N>(*halo, remote_el, getPosPtrFunc, cells);
 
-        Complexity cmplx = algorithm::CLL_compute_forces<N, T>(&acc, elements, remote_el, getPosPtrFunc, bbox, cut_off_radius, head, lscl, getForceFunc);
+        if(overlap) {
+            cmplx = compute_forces_overlapped<N>(nb_elements, bbox, cut_off_radius, cells, halo, *workspace, [&](const algorithm::CellSubset& subset) {
+                if(params->force_kernel == BatchedLJKernel)
+                    return algorithm::CLL_compute_forces_batched<N, T, G>(&acc, elements, remote_el, getPosPtrFunc, bbox, cut_off_radius, cells, params->eps_lj, sig2, shell, params->nb_threads, &subset, forces);
+                return algorithm::CLL_compute_forces_half_shell<N, T, G>(&acc, elements, remote_el, getPosPtrFunc, bbox, cut_off_radius, cells, getForceFunc, params->nb_threads, &subset, forces);
+            }, [&]() {
+                finish_ghost_exchange<N>(*halo, remote_el, getPosPtrFunc, cells);
+            });
+        } else if(verlet) {
+            if(!verlet->is_built())
+                verlet->build(elements.data(), nb_elements, remote_el.data(), remote_el.size(), getPosPtrFunc, bbox, cut_off_radius, cells, 2.5f * params->sig_lj);
+            cmplx = verlet->compute_forces(&acc, elements.data(), remote_el.data(), getPosPtrFunc, params->eps_lj, sig2, params->nb_threads);
+        } else if(params->force_kernel == BatchedLJKernel)
+            cmplx = algorithm::CLL_compute_forces_batched<N, T, G>(&acc, elements, remote_el, getPosPtrFunc, bbox, cut_off_radius, cells, params->eps_lj, sig2, shell, params->nb_threads, nullptr, forces);
+        else if(shell == HalfShell)
+            cmplx = algorithm::CLL_compute_forces_half_shell<N, T, G>(&acc, elements, remote_el, getPosPtrFunc, bbox, cut_off_radius, cells, getForceFunc, params->nb_threads, nullptr, forces);
+        else
+            cmplx = algorithm::CLL_compute_forces_full_shell<N, T, G>(&acc, elements, remote_el, getPosPtrFunc, bbox, cut_off_radius, cells, getForceFunc, params->nb_threads);
 
-        leapfrog2<N, T>(dt, acc, elements, getVelPtrFunc);
-        leapfrog1<N, T>(dt, cut_off_radius, acc, elements, getPosPtrFunc, getVelPtrFunc);
-        apply_reflect<N, T>(elements, params->simsize, getPosPtrFunc, getVelPtrFunc);
+        // every element is integrated independently, in a single sweep
+        const Integrator integrator(*params);
+        parallel::for_range(params->nb_threads, nb_elements, [&](size_t begin, size_t end) {
+            integrate<N>(integrator, acc, elements, getPosPtrFunc, getVelPtrFunc, begin, end);
+        });
 
         return cmplx;
     };
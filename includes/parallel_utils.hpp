@@ -6,10 +6,16 @@
 #define NBMPI_PARALLEL_UTILS_HPP
 
 #include "utils.hpp"
+#include "cell_lists.hpp"
+#include "cut_tree.hpp"
 
 #include <mpi.h>
 #include <vector>
 #include <numeric>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
 #include <set>
 
 using Real       = float;
@@ -49,38 +55,305 @@ struct Borders {
     std::vector<Index> bordering_cells;
 };
 
-std::vector<int> get_invert_list(const std::vector<int>& sends_to_procs, int* num_found, MPI_Comm comm) {
+/* Who sent which ghosts during the last full exchange, so that the same halo can be refreshed in place */
+struct GhostExchangePlan {
+    std::vector<Rank> send_ranks;
+    std::vector<std::vector<Index>> send_indices;
+    std::vector<Rank> recv_ranks;   // in the order the ghosts are stored
+    std::vector<int> recv_counts;
+
+    void clear() {
+        send_ranks.clear();
+        send_indices.clear();
+        recv_ranks.clear();
+        recv_counts.clear();
+    }
+};
 
-    int worldsize, rank = 0;
-    int how_many_to_import = 0;
+/* Number of sparse exchanges done on comm, cached as an attribute of the communicator */
+inline unsigned long& sparse_exchange_round(MPI_Comm comm) {
+    static int keyval = MPI_KEYVAL_INVALID;
+    if (keyval == MPI_KEYVAL_INVALID) {
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN,
+                               [](MPI_Comm, int, void* value, void*) { delete static_cast<unsigned long*>(value); return MPI_SUCCESS; },
+                               &keyval, nullptr);
+    }
+    void* value;
+    int found;
+    MPI_Comm_get_attr(comm, keyval, &value, &found);
+    if (!found) {
+        value = new unsigned long(0);
+        MPI_Comm_set_attr(comm, keyval, value);
+    }
+    return *static_cast<unsigned long*>(value);
+}
 
-    MPI_Comm_size(comm, &worldsize);
-    MPI_Comm_rank(comm, &rank);
+/**
+ * Send and receive buffers of one kind of exchange (halo, migration), kept from one call to the next so that a step
+ * does not allocate: a buffer is only created for a rank the first time it becomes a partner, cleared buffers keep
+ * their capacity and grow geometrically. Only the buffers of the current partners are touched, never wsize of them.
+ */
+template<class T>
+class CommBuffers {
+public:
+    /* largest values seen since the creation of the buffers */
+    struct HighWaterMarks {
+        size_t partners = 0, elements_sent = 0, elements_received = 0, bytes = 0;
+    };
+private:
+    std::vector<int> slot_of;                // rank -> slot of its send buffer, -1 when not a partner
+    std::vector<Rank> partners;              // ranks with a send buffer in the current exchange, slot k for partner k
+    std::vector<std::vector<T>> slots;
+    std::vector<T> recv;
+    std::vector<MPI_Request> requests;
+    HighWaterMarks peak;
+public:
+    /* forget the partners of the previous exchange, keep the memory */
+    void reset(int wsize) {
+        for (auto PE : partners) slot_of[PE] = -1;
+        slot_of.resize(wsize, -1);
+        partners.clear();
+        for (auto& buf : slots) buf.clear();
+    }
+
+    /* slot of the send buffer to PE, which becomes a partner */
+    size_t slot(Rank PE) {
+        int& k = slot_of.at(PE);
+        if (k < 0) {
+            k = partners.size();
+            partners.push_back(PE);
+            if (slots.size() < partners.size()) slots.emplace_back();
+        }
+        return k;
+    }
+
+    std::vector<T>& to(Rank PE) { return slots[slot(PE)]; }
+
+    size_t nb_partners() const { return partners.size(); }
+    Rank partner(size_t k) const { return partners[k]; }
+    std::vector<T>& send_buffer(size_t k) { return slots[k]; }
+    std::vector<T>& recv_buffer() { return recv; }
+    std::vector<MPI_Request>& get_requests() { return requests; }
+
+    /* update the high-water marks with the current exchange, received: number of elements received */
+    void record(size_t received) {
+        size_t sent = nb_elements_sent(), bytes = recv.capacity() * sizeof(T) + requests.capacity() * sizeof(MPI_Request);
+        for (const auto& buf : slots) bytes += buf.capacity() * sizeof(T);
+        peak.partners          = std::max(peak.partners, partners.size());
+        peak.elements_sent     = std::max(peak.elements_sent, sent);
+        peak.elements_received = std::max(peak.elements_received, received);
+        peak.bytes             = std::max(peak.bytes, bytes);
+    }
+
+    /* elements in the send buffers of the current partners */
+    size_t nb_elements_sent() const {
+        size_t sent = 0;
+        for (size_t k = 0; k < partners.size(); ++k) sent += slots[k].size();
+        return sent;
+    }
+
+    const HighWaterMarks& high_water_marks() const { return peak; }
+};
 
-    std::vector<int> import_from_procs;
+/**
+ * Sparse data exchange (NBX): every non-empty buffer is sent with a synchronous send, incoming messages are received
+ * as they arrive and a non-blocking barrier is entered once all my sends have been matched. When the barrier completes,
+ * every message of the exchange has been received. There is no all-to-all handshake, the cost depends on the number
+ * of actual partners instead of the size of the communicator.
+ * A rank leaving the barrier may already send the messages of the next exchange to a rank still probing, hence
+ * consecutive exchanges on the same communicator alternate between tag and tag + NBX_TAG_PARITY.
+ * The sends are posted on construction; progress() does one probe/test round and wait() completes the exchange, so
+ * that the caller may compute in between. Only the thread that created the exchange may progress it.
+ */
+template<class T>
+class SparseExchange {
+    static constexpr int NBX_TAG_PARITY = 1 << 12;
+    std::unique_ptr<CommBuffers<T>> owned;
+    CommBuffers<T>* buffers;
+    std::function<void (int, const T*, int)> onRecvFunc;
+    MPI_Datatype datatype;
+    MPI_Comm comm;
+    int tag;
+    MPI_Request barrier = MPI_REQUEST_NULL;
+    bool barrier_active = false;
+    int done = 0;
+    size_t received = 0;
+public:
+    /**
+     * @param buffers send buffers of the partners, filled by the caller; they must stay untouched until the exchange
+     *        completes
+     * @param onRecvFunc called with (source rank, received data, count) for each incoming message
+     */
+    SparseExchange(CommBuffers<T>* buffers, MPI_Datatype datatype, int tag, MPI_Comm comm,
+                   std::function<void (int, const T*, int)> onRecvFunc) :
+            SparseExchange(nullptr, buffers, datatype, tag, comm, std::move(onRecvFunc)) {}
+
+    /* same, the exchange owns the buffers (one-shot exchange of a caller without an arena) */
+    SparseExchange(std::unique_ptr<CommBuffers<T>> buffers, MPI_Datatype datatype, int tag, MPI_Comm comm,
+                   std::function<void (int, const T*, int)> onRecvFunc) :
+            SparseExchange(std::move(buffers), nullptr, datatype, tag, comm, std::move(onRecvFunc)) {}
+private:
+    SparseExchange(std::unique_ptr<CommBuffers<T>> owned_buffers, CommBuffers<T>* borrowed, MPI_Datatype datatype,
+                   int tag, MPI_Comm comm, std::function<void (int, const T*, int)> onRecvFunc) :
+            owned(std::move(owned_buffers)), buffers(owned ? owned.get() : borrowed), onRecvFunc(std::move(onRecvFunc)),
+            datatype(datatype), comm(comm), tag(tag + (sparse_exchange_round(comm)++ & 1) * NBX_TAG_PARITY) {
+        auto& send_reqs = buffers->get_requests();
+        send_reqs.clear();
+        for (size_t k = 0; k < buffers->nb_partners(); ++k) {
+            const auto& buf = buffers->send_buffer(k);
+            if (buf.empty()) continue;
+            send_reqs.emplace_back();
+            MPI_Issend(buf.data(), buf.size(), datatype, buffers->partner(k), this->tag, comm, &send_reqs.back());
+        }
+    }
+public:
+
+    SparseExchange(SparseExchange&&) = default;
+    SparseExchange(const SparseExchange&) = delete;
+    SparseExchange& operator=(const SparseExchange&) = delete;
+
+    bool is_done() const { return done; }
+
+    /* receive at most one message and test the termination, true once the exchange is complete */
+    bool progress() {
+        if (done) return true;
+        int flag, size;
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status);
+        if (flag) {
+            auto& buffer = buffers->recv_buffer();
+            MPI_Get_count(&status, datatype, &size);
+            buffer.resize(size);
+            MPI_Recv(buffer.data(), size, datatype, status.MPI_SOURCE, tag, comm, MPI_STATUS_IGNORE);
+            onRecvFunc(status.MPI_SOURCE, buffer.data(), size);
+            received += size;
+        }
+        if (barrier_active) {
+            MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+            if (done) buffers->record(received);
+        } else {
+            auto& send_reqs = buffers->get_requests();
+            int all_sent;
+            MPI_Testall(send_reqs.size(), send_reqs.data(), &all_sent, MPI_STATUSES_IGNORE);
+            if (all_sent) {
+                MPI_Ibarrier(comm, &barrier);
+                barrier_active = true;
+            }
+        }
+        return done;
+    }
 
-    // create requet to send/recv
-    std::vector<MPI_Request> recv_req(worldsize, MPI_REQUEST_NULL);
-    std::vector<MPI_Request> send_req(worldsize, MPI_REQUEST_NULL);
+    void wait() { while (!progress()); }
+};
 
-    // Send the HOW MANY to my neighbors
-    for(int PE = 0; PE < worldsize; PE++) {
-        MPI_Send(&sends_to_procs.at(PE), 1, MPI_INT, PE, 2, comm);
+/* Blocking sparse exchange of the send buffers of the partners, see SparseExchange */
+template<class T, class OnRecvFunc>
+void sparse_exchange(CommBuffers<T>* buffers,
+                     MPI_Datatype datatype, int tag, MPI_Comm comm,
+                     OnRecvFunc onRecvFunc) {
+    SparseExchange<T>(buffers, datatype, tag, comm, onRecvFunc).wait();
+}
+
+/* Load statistics of one iteration: max, min and sum of the iteration time, max of the load balancing time */
+struct IterationLoad {
+    Time max_it = 0, min_it = 0, sum_it = 0, lb_time = 0;
+};
+
+/**
+ * Reduces the IterationLoad of every rank in a single collective with a user-defined operation, instead of one
+ * MPI_Allreduce per statistic.
+ * Deferred: the reduction of an iteration is posted with MPI_Iallreduce and completed by the next call, so the
+ * statistics lag one iteration behind and no rank waits on the slowest one at the end of a step.
+ */
+class LoadStatistics {
+    MPI_Comm comm;
+    bool deferred;
+    MPI_Datatype datatype;
+    MPI_Op op;
+    MPI_Request request = MPI_REQUEST_NULL;
+    IterationLoad local, global;
+
+    static void combine(void* in, void* inout, int* len, MPI_Datatype*) {
+        auto a = static_cast<const IterationLoad*>(in);
+        auto b = static_cast<IterationLoad*>(inout);
+        for (int i = 0; i < *len; ++i) {
+            b[i].max_it  = std::max(a[i].max_it, b[i].max_it);
+            b[i].min_it  = std::min(a[i].min_it, b[i].min_it);
+            b[i].sum_it += a[i].sum_it;
+            b[i].lb_time = std::max(a[i].lb_time, b[i].lb_time);
+        }
+    }
+public:
+    explicit LoadStatistics(MPI_Comm comm, bool deferred = false) : comm(comm), deferred(deferred) {
+        static_assert(sizeof(IterationLoad) == 4 * sizeof(double), "IterationLoad must be four doubles");
+        MPI_Type_contiguous(4, MPI_DOUBLE, &datatype);
+        MPI_Type_commit(&datatype);
+        MPI_Op_create(&LoadStatistics::combine, 1, &op);
+    }
+    LoadStatistics(const LoadStatistics&) = delete;
+    LoadStatistics& operator=(const LoadStatistics&) = delete;
+    ~LoadStatistics() {
+        if (request != MPI_REQUEST_NULL) MPI_Wait(&request, MPI_STATUS_IGNORE);
+        MPI_Op_free(&op);
+        MPI_Type_free(&datatype);
     }
 
-    int recv_size = 0;
-    for(int PE = 0; PE < worldsize; PE++) {
-        MPI_Recv(&recv_size, 1, MPI_INT, PE, 2, comm, MPI_STATUS_IGNORE);
-        if(PE != rank && recv_size > 0){
-            import_from_procs.push_back(PE);
-            how_many_to_import += recv_size;
+    /**
+     * Collective: contribute the times of this iteration.
+     * @return whether load holds reduced statistics: those of this iteration, or of the previous one when deferred
+     */
+    bool reduce(Time it_time, Time lb_time, IterationLoad* load) {
+        const bool ready = flush(load);
+        local = {it_time, it_time, it_time, lb_time};
+        if (deferred) {
+            MPI_Iallreduce(&local, &global, 1, datatype, op, comm, &request);
+            return ready;
         }
+        MPI_Allreduce(&local, load, 1, datatype, op, comm);
+        return true;
+    }
+
+    /* complete the reduction still in flight, if any */
+    bool flush(IterationLoad* load) {
+        if (request == MPI_REQUEST_NULL) return false;
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        *load = global;
+        return true;
     }
+};
 
-    *num_found = how_many_to_import;
-    return import_from_procs;
+/* f(x, y, z) for every cell on the faces of a grid of lc cells (z = 0 in 2D) */
+template<int N, class F>
+void for_each_surface_cell(const std::array<Integer, N>& lc, F f) {
+    Integer lz = 1;
+    if constexpr (N == 3) lz = lc[2];
+    for(Integer z = 0; z < lz; ++z){
+        for(Integer y = 0; y < lc[1]; ++y){
+            Integer condition = !(y^0)|!(y^(lc[1]-1));
+            if constexpr (N == 3) condition |= !(z^0)|!(z^(lz-1));
+            for(Integer x = 0; x < lc[0]; x += bitselect(condition, (Integer) 1, std::max((Integer) 1, lc[0] - 1))) f(x, y, z);
+        }
+    }
 }
 
+/* Ranks whose partition intersects the cell of lower corner (cx, cy, cz) extended by rc/2 on each side */
+template<int N, class LoadBalancer, class BoxIntersectFunc>
+void get_cell_neighbors(LoadBalancer* LB, double cx, double cy, double cz, const Real rc,
+                        BoxIntersectFunc boxIntersectFunc, std::vector<Rank>* PEs) {
+    int num_found;
+    if constexpr (N == 3) {
+        boxIntersectFunc(LB,
+                cx + rc/2.0 - rc, cy + rc/2.0 - rc, cz + rc/2.0 - rc,
+                cx + rc/2.0 + rc, cy + rc/2.0 + rc, cz + rc/2.0 + rc,
+                &PEs->front(), &num_found);
+    } else {
+        boxIntersectFunc(LB,
+                cx + rc/2.0 - rc, cy + rc/2.0 - rc, 0.0,
+                cx + rc/2.0 + rc, cy + rc/2.0 + rc, 0.0,
+                &PEs->front(), &num_found);
+    }
+    PEs->resize(num_found);
+}
 
 template<int N, class LoadBalancer, class BoxIntersectFunc>
 Borders get_border_cells_index(
@@ -89,7 +362,7 @@ Borders get_border_cells_index(
         const Real rc,
         BoxIntersectFunc boxIntersectFunc,
         MPI_Comm comm) {
-    int caller_rank, wsize, num_found;
+    int caller_rank, wsize;
 
     MPI_Comm_rank(comm, &caller_rank);
     MPI_Comm_size(comm, &wsize);
@@ -97,259 +370,274 @@ Borders get_border_cells_index(
     if (wsize == 1) return {};
     auto lc = get_cell_number_by_dimension<N>(bbox, rc);
 
-    std::vector<Index> bordering_cell_index;
-    // number of bordering cell in 3D is xyz - (x-2)(y-2)(z-2)
-    int nb_local_cells     = std::accumulate(lc.cbegin(), lc.cend(), 1, [](auto p, auto v){return p*v;});
-    int nb_bordering_cells = std::min(nb_local_cells, nb_local_cells - std::accumulate(lc.cbegin(), lc.cend(), 1, [](auto p, auto v){return p * (v-2);}));
-
-    // If I have no bordering cell (impossible, but we never know (: )
-    if(nb_bordering_cells <= 0) return {};
+    Borders borders;
+    std::vector<Rank> PEs;
+    for_each_surface_cell<N>(lc, [&](Integer x, Integer y, Integer z) {
+        PEs.resize(wsize);
+        get_cell_neighbors<N>(LB, bbox[0] + x*rc, bbox[2] + y*rc, N == 3 ? bbox[2*N-2] + z*rc : 0.0, rc, boxIntersectFunc, &PEs);
+        if(!PEs.empty()){
+            borders.bordering_cells.push_back(CoordinateTranslater::translate_xyz_into_linear_index<N>({x,y,z}, bbox, rc));
+            borders.neighbors.push_back(PEs);
+        }
+    });
+    return borders;
+}
 
-    bordering_cell_index.reserve(nb_bordering_cells);
+/**
+ * get_border_cells_index with memory: the neighbouring ranks of every cell already queried are kept, keyed by the
+ * global grid coordinates of the cell (bounding boxes are hooked to the grid of rc), so that a new bbox only queries
+ * the load balancer for the surface cells never seen before, and an unchanged bbox returns the previous Borders.
+ * The entries are valid for one partition: call invalidate() whenever the load balancer changes it.
+ */
+template<int N>
+class BorderCache {
+    unsigned long epoch = 0, borders_epoch = std::numeric_limits<unsigned long>::max();
+    BoundingBox<N> borders_bbox;
+    Real borders_rc = 0;
+    Borders borders;
+    std::map<std::array<Integer, N>, std::vector<Rank>> neighbors_of;
+public:
+    /* the partition changed */
+    void invalidate() {
+        epoch++;
+        neighbors_of.clear();
+    }
 
-    std::vector<Rank> PEs(wsize);
-    std::vector< std::vector<Rank> > neighbors(nb_bordering_cells);
-    std::for_each(neighbors.begin(), neighbors.end(), [](auto& vec){vec.reserve(10);});
-    std::array<double, N> pos_in_double;
-    Integer border_cell_cnt = 0;
-    for(Integer z = 0; z < lc[2]; ++z){
-        for(Integer y = 0; y < lc[1]; ++y){
-            Integer condition = !(y^0)|!(y^(lc[1]-1)) | !(z^0)|!(z^(lc[2]-1));
-            for(Integer x = 0; x < lc[0]; x += bitselect(condition, (Integer) 1, lc[0] - 1)) {
-                Index cell_id = CoordinateTranslater::translate_xyz_into_linear_index<N>({x,y,z}, bbox, rc);
-                put_in_double_array<N>(pos_in_double, CoordinateTranslater::translate_local_index_into_position<N>(cell_id, bbox, rc));
-                if constexpr (N == 3) {
-                    boxIntersectFunc(LB,
-                            pos_in_double.at(0) + rc/2.0 - rc, pos_in_double.at(1) + rc/2.0 - rc,
-                            pos_in_double.at(2) + rc/2.0 - rc, pos_in_double.at(0) + rc/2.0 + rc,
-                            pos_in_double.at(1) + rc/2.0 + rc, pos_in_double.at(2) + rc/2.0 + rc,
-                            &PEs.front(), &num_found);
-                } else {
-                    boxIntersectFunc(LB,
-                            pos_in_double.at(0) + rc/2.0 - rc, pos_in_double.at(1) + rc/2.0 - rc,
-                            0.0, pos_in_double.at(0) + rc/2.0 + rc,
-                            pos_in_double.at(1) + rc/2.0 + rc, 0.0,
-                            &PEs.front(), &num_found);
-                }
-                if(num_found){
-                    bordering_cell_index.push_back(cell_id);
-                    neighbors.at(border_cell_cnt).assign(PEs.begin(), PEs.begin() + num_found);
-                    border_cell_cnt++;
-                }
+    unsigned long get_epoch() const { return epoch; }
+
+    template<class LoadBalancer, class BoxIntersectFunc>
+    const Borders& get(LoadBalancer* LB, const BoundingBox<N>& bbox, const Real rc,
+                       BoxIntersectFunc boxIntersectFunc, MPI_Comm comm) {
+        if(borders_epoch == epoch && borders_bbox == bbox && borders_rc == rc) return borders;
+
+        int wsize;
+        MPI_Comm_size(comm, &wsize);
+        borders = {};
+        borders_epoch = epoch;
+        borders_bbox = bbox;
+        borders_rc = rc;
+        if (wsize == 1) return borders;
+
+        const auto lc = get_cell_number_by_dimension<N>(bbox, rc);
+        std::array<Integer, N> origin;
+        for(int dim = 0; dim < N; ++dim) origin[dim] = std::llround(bbox[2*dim] / rc);
+
+        for_each_surface_cell<N>(lc, [&](Integer x, Integer y, Integer z) {
+            std::array<Integer, N> cell;
+            cell[0] = origin[0] + x;
+            cell[1] = origin[1] + y;
+            if constexpr (N == 3) cell[2] = origin[2] + z;
+            auto it = neighbors_of.find(cell);
+            if(it == neighbors_of.end()) {
+                std::vector<Rank> PEs(wsize);
+                get_cell_neighbors<N>(LB, bbox[0] + x*rc, bbox[2] + y*rc, N == 3 ? bbox[2*N-2] + z*rc : 0.0, rc, boxIntersectFunc, &PEs);
+                it = neighbors_of.emplace(cell, std::move(PEs)).first;
             }
-        }
+            if(!it->second.empty()){
+                borders.bordering_cells.push_back(CoordinateTranslater::translate_xyz_into_linear_index<N>({x,y,z}, bbox, rc));
+                borders.neighbors.push_back(it->second);
+            }
+        });
+        return borders;
     }
-    return {neighbors, bordering_cell_index};
-}
-
+};
 
-template<class T>
-std::vector<T> exchange_data(
+/**
+ * Post the elements of the bordering cells to the neighbors; the received ghosts are appended to remote_data as the
+ * returned exchange progresses (remote_data must stay alive and untouched until it completes).
+ * The ghosts are sent as G records built from the elements (G(element)), e.g. elements::Ghost<N> to only send the
+ * positions, datatype being the MPI datatype of G.
+ */
+template<int N, class T, class G = T>
+SparseExchange<G> start_exchange_data(
         const std::vector<T> &data,
-        const std::vector<Integer>* head,
-        const std::vector<Integer>* lscl,
+        const algorithm::CellLists<N>* cells,
         const Borders& bordering_cells,
         MPI_Datatype datatype,
         MPI_Comm LB_COMM,
-        int &nb_elements_recv,
-        int &nb_elements_sent) {
-
-    const auto nb_elements = data.size();
-
+        std::vector<G>* remote_data,
+        GhostExchangePlan* plan = nullptr,
+        CommBuffers<G>* buffers = nullptr) {
     int wsize, caller_rank;
     MPI_Comm_size(LB_COMM, &wsize);
     MPI_Comm_rank(LB_COMM, &caller_rank);
 
-    std::vector<T> buffer;
-    std::vector<T> remote_data_gathered;
+    remote_data->clear();
+    if(plan) plan->clear();
 
-    if (wsize == 1)
-        return remote_data_gathered;
+    std::unique_ptr<CommBuffers<G>> owned;
+    if(!buffers) buffers = (owned = std::make_unique<CommBuffers<G>>()).get();
+    buffers->reset(wsize);
 
-    std::vector<std::vector<T > > data_to_migrate(wsize);
-    std::for_each(data_to_migrate.begin(), data_to_migrate.end(),
-                  [size = nb_elements, wsize](auto &buf) { buf.reserve(size / wsize); });
-
-    int num_found, num_known = 0;
-
-    std::vector<int> export_gids, export_lids, export_procs;
     int cell_cnt = 0;
-    for(auto cidx : bordering_cells.bordering_cells) {
-        auto p = head->at(cidx);
-        while(p != -1) {
-            num_known += bordering_cells.neighbors.at(cell_cnt).size();
-            p = lscl->at(p);
-        }
-        cell_cnt++;
-    }
-    export_gids.resize(num_known);
-    export_lids.resize(num_known);
-    export_procs.resize(num_known);
-
-    cell_cnt = 0;
-    num_known = 0;
     for(auto cidx : bordering_cells.bordering_cells){
-        auto p = head->at(cidx);
-        while(p != -1){
-            for(auto rank : bordering_cells.neighbors.at(cell_cnt)) {
+        const auto& ranks = bordering_cells.neighbors.at(cell_cnt);
+        cells->for_each(cidx, [&](Integer p) {
+            for(auto rank : ranks) {
                 if(rank != caller_rank){
-                    const auto& el = data[p];
-                    export_gids[num_known] = el.gid;
-                    export_lids[num_known] = el.lid;
-                    export_procs[num_known] = rank;
-                    data_to_migrate.at(rank).push_back(el);
-                    num_known ++;
+                    const auto k = buffers->slot(rank);
+                    buffers->send_buffer(k).push_back(G(data[p]));
+                    if(plan) {
+                        if(plan->send_indices.size() <= k) plan->send_indices.resize(k + 1);
+                        plan->send_indices[k].push_back(p);
+                    }
                 }
             }
-            p = lscl->at(p);
-        }
+        });
         cell_cnt++;
     }
-    std::vector<int> sends_to_proc(wsize);
-    std::transform(data_to_migrate.cbegin(), data_to_migrate.cend(), std::begin(sends_to_proc), [](const auto& el){return el.size();});
-
-    auto import_from_procs = get_invert_list(sends_to_proc, &num_found, LB_COMM);
-
-    int nb_reqs = std::count_if(data_to_migrate.cbegin(), data_to_migrate.cend(), [](const auto& buf){return !buf.empty();});
-    int cpt = 0;
-
-    // Send the data to neighbors
-    std::vector<MPI_Request> reqs(nb_reqs);
-    nb_elements_sent = 0;
-    for (size_t PE = 0; PE < wsize; PE++) {
-        int send_size = data_to_migrate.at(PE).size();
-        if (send_size) {
-            nb_elements_sent += send_size;
-            MPI_Isend(&data_to_migrate.at(PE).front(), send_size, datatype, PE, 400, LB_COMM, &reqs[cpt]);
-            cpt++;
-        }
+    if(plan) {
+        for (size_t k = 0; k < buffers->nb_partners(); ++k) plan->send_ranks.push_back(buffers->partner(k));
     }
 
-    // Import the data from neighbors
-    nb_elements_recv = 0;
-    remote_data_gathered.reserve(num_found);
-    int recv_count = import_from_procs.size();
-    MPI_Status status;
-    int size;
-    while(recv_count) {
-        // Probe for next incoming message
-        MPI_Probe(MPI_ANY_SOURCE, 400, LB_COMM, &status);
-        // Get message size
-        MPI_Get_count(&status, datatype, &size);
-        nb_elements_recv += size;
-        // Resize buffer if needed
-        if(buffer.capacity() < size) buffer.reserve(size);
-        // Receive data
-        MPI_Recv(buffer.data(), size, datatype, status.MPI_SOURCE, 400, LB_COMM, MPI_STATUS_IGNORE);
-        // Move to my data
-        std::move(buffer.begin(), buffer.begin()+size, std::back_inserter(remote_data_gathered));
-        // One less message to recover
-        recv_count--;
+    auto onRecv = [remote_data, plan](int source, const G* recv, int size) {
+        remote_data->insert(remote_data->end(), recv, recv + size);
+        if(plan) {
+            plan->recv_ranks.push_back(source);
+            plan->recv_counts.push_back(size);
+        }
+    };
+    if(owned) return SparseExchange<G>(std::move(owned), datatype, 400, LB_COMM, onRecv);
+    return SparseExchange<G>(buffers, datatype, 400, LB_COMM, onRecv);
+}
+
+template<int N, class T>
+std::vector<T> exchange_data(
+        const std::vector<T> &data,
+        const algorithm::CellLists<N>* cells,
+        const Borders& bordering_cells,
+        MPI_Datatype datatype,
+        MPI_Comm LB_COMM,
+        int &nb_elements_recv,
+        int &nb_elements_sent,
+        GhostExchangePlan* plan = nullptr) {
+    int wsize;
+    MPI_Comm_size(LB_COMM, &wsize);
+
+    std::vector<T> remote_data_gathered;
+    nb_elements_recv = nb_elements_sent = 0;
+    if (wsize == 1) {
+        if(plan) plan->clear();
+        return remote_data_gathered;
     }
 
-    MPI_Waitall(reqs.size(), &reqs.front(), MPI_STATUSES_IGNORE);
+    auto exchange = start_exchange_data(data, cells, bordering_cells, datatype, LB_COMM, &remote_data_gathered, plan);
+    int caller_rank, cell_cnt = 0;
+    MPI_Comm_rank(LB_COMM, &caller_rank);
+    for(auto cidx : bordering_cells.bordering_cells) {
+        const auto& ranks = bordering_cells.neighbors.at(cell_cnt++);
+        const int nb_dest = std::count_if(ranks.cbegin(), ranks.cend(), [caller_rank](auto r){ return r != caller_rank; });
+        nb_elements_sent += nb_dest * cells->count(cidx);
+    }
+    exchange.wait();
+    nb_elements_recv = remote_data_gathered.size();
 
     return remote_data_gathered;
 }
 
+/**
+ * Send the up-to-date copy of the ghosts recorded in the plan; received ghosts overwrite remote_data in place,
+ * in the same order as during the exchange that built the plan.
+ */
+template<class T, class G>
+void refresh_ghost_data(
+        const std::vector<T> &data,
+        std::vector<G> &remote_data,
+        const GhostExchangePlan& plan,
+        MPI_Datatype datatype,
+        MPI_Comm LB_COMM,
+        CommBuffers<G>* buffers = nullptr) {
+    const auto nb_sends = plan.send_ranks.size(), nb_recvs = plan.recv_ranks.size();
+    if(nb_sends + nb_recvs == 0) return;
+
+    int wsize;
+    MPI_Comm_size(LB_COMM, &wsize);
+    CommBuffers<G> local;
+    if(!buffers) buffers = &local;
+    buffers->reset(wsize);
+    auto& reqs = buffers->get_requests();
+    reqs.assign(nb_sends + nb_recvs, MPI_REQUEST_NULL);
+
+    int offset = 0;
+    for (size_t r = 0; r < nb_recvs; ++r) {
+        MPI_Irecv(&remote_data.at(offset), plan.recv_counts[r], datatype, plan.recv_ranks[r], 401, LB_COMM, &reqs[r]);
+        offset += plan.recv_counts[r];
+    }
+    for (size_t s = 0; s < nb_sends; ++s) {
+        auto& buf = buffers->to(plan.send_ranks[s]);
+        for (auto p : plan.send_indices[s]) buf.push_back(G(data[p]));
+        MPI_Isend(buf.data(), buf.size(), datatype, plan.send_ranks[s], 401, LB_COMM, &reqs[nb_recvs + s]);
+    }
+    MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+    buffers->record(offset);
+}
+
+/* the elements (all of them, or the candidates) that do not belong to the caller and their destination */
+template<class T, class LoadBalancer, class PointAssignFunc>
+void get_leaving_elements(LoadBalancer* LB, const std::vector<T>& data, const std::vector<Index>* candidates,
+                          PointAssignFunc pointAssignFunc, int caller_rank, std::vector<std::pair<Index, int>>* leaving) {
+    int PE;
+    const Index n = candidates ? candidates->size() : data.size();
+    for (Index k = 0; k < n; ++k) {
+        const Index id = candidates ? (*candidates)[k] : k;
+        pointAssignFunc(LB, data[id], &PE);
+        if (PE != caller_rank) leaving->emplace_back(id, PE);
+    }
+}
+
+/* with the cuts of the partition, the elements are assigned in one batch */
+template<class T, class PointAssignFunc>
+void get_leaving_elements(const partitioning::CutTree* LB, const std::vector<T>& data, const std::vector<Index>* candidates,
+                          PointAssignFunc, int caller_rank, std::vector<std::pair<Index, int>>* leaving) {
+    const Index n = candidates ? candidates->size() : data.size();
+    std::vector<int> PEs(n);
+    if (candidates) LB->point_assign(n, [&](Index k) -> const auto& { return data[(*candidates)[k]].position; }, PEs.data());
+    else            LB->point_assign(n, [&](Index k) -> const auto& { return data[k].position; }, PEs.data());
+    for (Index k = 0; k < n; ++k)
+        if (PEs[k] != caller_rank) leaving->emplace_back(candidates ? (*candidates)[k] : k, PEs[k]);
+}
+
 template<class T, class LoadBalancer, class PointAssignFunc>
 typename std::vector<T>::const_iterator migrate_data(
         LoadBalancer* LB,
         std::vector<T> &data,
         PointAssignFunc pointAssignFunc,
         MPI_Datatype datatype,
-        MPI_Comm LB_COMM) {
+        MPI_Comm LB_COMM,
+        const std::vector<Index>* candidates = nullptr,
+        CommBuffers<T>* buffers = nullptr) {
     int wsize;
     MPI_Comm_size(LB_COMM, &wsize);
     int caller_rank;
     MPI_Comm_rank(LB_COMM, &caller_rank);
     const auto prev_size = data.size();
     if(wsize == 1) return data.cend();
-    auto nb_elements = data.size();
 
-    std::vector< std::vector<T> > data_to_migrate(wsize);
-    std::for_each(data_to_migrate.begin(), data_to_migrate.end(),
-                  [size = nb_elements, wsize](auto &buf) { buf.reserve(size / wsize); });
+    CommBuffers<T> local;
+    if(!buffers) buffers = &local;
+    buffers->reset(wsize);
 
-    size_t data_id = 0;
-    int PE, num_known = 0, num_found;
-    std::vector<int> import_from_procs;
     {
-        std::vector<int> export_gids, export_lids, export_procs;
-        export_gids.reserve(nb_elements / wsize);
-        export_lids.reserve(nb_elements / wsize);
-        export_procs.reserve(nb_elements / wsize);
-
-        while (data_id < nb_elements) {
-            pointAssignFunc(LB, data.at(data_id), &PE);
-            if (PE != caller_rank) {
-                export_gids.push_back(data.at(data_id).gid);
-                export_lids.push_back(data.at(data_id).lid);
-                export_procs.push_back(PE);
-                //if the current element has to be moved, then swap with the last and pop it out (dont need to move the pointer also)
-                //swap iterator values in constant time
-                std::iter_swap(data.begin() + data_id, data.end() - 1);
-                //get the value and push it in the "to migrate" vector
-                data_to_migrate.at(PE).push_back(*(data.end() - 1));
-                //pop the head of the list in constant time
-                data.pop_back();
-                nb_elements--;
-                num_known++;
-            } else data_id++; //if the element must stay with me then check the next one
+        // only the candidates are checked when given; leaving elements are removed from the back so that the swap
+        // with the last element never moves an element that still has to leave
+        std::vector<std::pair<Index, int>> leaving;
+        get_leaving_elements(LB, data, candidates, pointAssignFunc, caller_rank, &leaving);
+        std::sort(leaving.begin(), leaving.end(), [](const auto& a, const auto& b){ return a.first > b.first; });
+        for (const auto& [id, dest] : leaving) {
+            std::iter_swap(data.begin() + id, data.end() - 1);
+            buffers->to(dest).push_back(*(data.end() - 1));
+            data.pop_back();
         }
-        export_gids.shrink_to_fit();
-        export_lids.shrink_to_fit();
-        export_procs.shrink_to_fit();
-        std::vector<int> sends_to_proc(wsize);
-        std::transform(data_to_migrate.cbegin(), data_to_migrate.cend(), std::begin(sends_to_proc), [](const auto& el){return el.size();});
-
-        import_from_procs = get_invert_list(sends_to_proc, &num_found, LB_COMM);
     }
 
-    data.reserve(nb_elements + num_found);
-
     /* Let's Migrate ma boi ! */
-
-    int nb_reqs = std::count_if(data_to_migrate.cbegin(), data_to_migrate.cend(), [](const auto& buf){return !buf.empty();});
-
-    int cpt = 0;
-
-    std::vector<MPI_Request> reqs(nb_reqs);
-    for (size_t PE = 0; PE < wsize; PE++) {
-        int send_size = data_to_migrate.at(PE).size();
-        if (send_size) {
-            MPI_Isend(&data_to_migrate.at(PE).front(), send_size, datatype, PE, 300, LB_COMM,
-                      &reqs[cpt]);
-            cpt++;
-        }
-    }
-
-    std::vector<T> buffer;
-
-    int recv_count = import_from_procs.size();
-    MPI_Status status;
-    int size;
-    while(recv_count) {
-        // Probe for next incoming message
-        MPI_Probe(MPI_ANY_SOURCE, 300, LB_COMM, &status);
-
-        // Get message size
-        MPI_Get_count(&status, datatype, &size);
-        // Resize buffer if needed
-        if(buffer.capacity() < size) buffer.reserve(size);
-        // Receive data
-        MPI_Recv(buffer.data(), size, datatype, status.MPI_SOURCE, 300, LB_COMM, MPI_STATUS_IGNORE);
-        // Move to my data
-        std::move(buffer.begin(), buffer.begin()+size, std::back_inserter(data));
-        // One less message to recover
-        recv_count--;
-    }
+    sparse_exchange(buffers, datatype, 300, LB_COMM, [&data](int, const T* recv, int size) {
+        data.insert(data.end(), recv, recv + size);
+    });
 
     const int nb_data = data.size();
     for(int i = 0; i < nb_data; ++i) data[i].lid = i;
 
-    MPI_Waitall(reqs.size(), &reqs.front(), MPI_STATUSES_IGNORE);
-
     return std::next(data.begin(), nb_data - prev_size);
 }
 
@@ -373,22 +661,146 @@ inline void gather_elements_on(const int world_size,
                 &displs.front(), sendtype, dest_rank, comm);
 }
 
+/**
+ * Build the cell lists of the local elements and post the elements of the bordering cells to the neighbors.
+ * The ghosts are received into remote_el while the returned exchange progresses; finish_ghost_exchange completes it
+ * and appends the ghosts to the cell lists. In between, the cell lists only hold the local elements, which is enough
+ * for the interior cells (see is_interior_cell).
+ */
+template<int N, class T, class G, class GetPosFunc>
+SparseExchange<G> start_ghost_exchange(
+        std::vector<T>& elements,
+        GetPosFunc getPosFunc,
+        algorithm::CellLists<N>* cells,
+        BoundingBox<N>& bbox, const Borders& borders, Real rc,
+        MPI_Datatype datatype, MPI_Comm comm,
+        std::vector<G>* remote_el,
+        GhostExchangePlan* plan = nullptr,
+        CommBuffers<G>* buffers = nullptr) {
+    cells->build(elements.data(), elements.size(), getPosFunc, bbox, rc);
+    return start_exchange_data<N, T, G>(elements, cells, borders, datatype, comm, remote_el, plan, buffers);
+}
+
+/* Wait for the ghosts and append them to the cell lists after the local elements */
+template<int N, class G, class GetPosFunc>
+void finish_ghost_exchange(
+        SparseExchange<G>& exchange,
+        const std::vector<G>& remote_el,
+        GetPosFunc getPosFunc,
+        algorithm::CellLists<N>* cells) {
+    exchange.wait();
+    cells->append(remote_el.data(), remote_el.size(), getPosFunc);
+}
+
+/**
+ * Build the cell lists of the local elements, send the elements of the bordering cells to the neighbors and append
+ * the received ghosts to the same lists (indices nb_elements and beyond). The lists are then valid for the force
+ * computation and the migration candidate selection of the step; they are built once per step.
+ */
 template<int N, class T, class GetPosFunc>
 std::vector<T> get_ghost_data(
         std::vector<T>& elements,
         GetPosFunc getPosFunc,
-        std::vector<Integer>* head, std::vector<Integer>* lscl,
+        algorithm::CellLists<N>* cells,
         BoundingBox<N>& bbox, Borders borders, Real rc,
-        MPI_Datatype datatype, MPI_Comm comm){
-    int r,s;
-    MPI_Comm_size(comm, &s);
+        MPI_Datatype datatype, MPI_Comm comm,
+        GhostExchangePlan* plan = nullptr,
+        CommBuffers<T>* buffers = nullptr){
+    std::vector<T> remote_el;
+    auto exchange = start_ghost_exchange<N>(elements, getPosFunc, cells, bbox, borders, rc, datatype, comm, &remote_el, plan, buffers);
+    finish_ghost_exchange<N>(exchange, remote_el, getPosFunc, cells);
+    return remote_el;
+}
 
-    if(s == 1) return {};
+/**
+ * A cell more than three cells away from the faces of bbox. The partition contains the bounding box of its elements,
+ * which bbox extends by two cells, so the cell and its neighbours lie inside the partition: it holds no ghost, has no
+ * ghost neighbour, and its elements cannot leave the partition within one step (they move by less than one cell per
+ * step, see leapfrog1). A wider margin covers elements that may move by more than one cell.
+ */
+template<int N>
+bool is_interior_cell(Integer c, const std::array<Integer, N>& lc, Integer margin = 4) {
+    for(int dim = 0; dim < N; ++dim) {
+        const Integer x = c % lc[dim];
+        c /= lc[dim];
+        if(x < margin || x >= lc[dim] - margin) return false;
+    }
+    return true;
+}
 
-    const size_t nb_elements = elements.size();
-    if(const auto n_cells = get_total_cell_number<N>(bbox, rc); head->size() < n_cells){ head->resize(n_cells); }
-    if(nb_elements > lscl->size()) { lscl->resize(nb_elements); }
-    algorithm::CLL_init<N, T>({{elements.data(), nb_elements}}, getPosFunc, bbox, rc, head, lscl);
-    return exchange_data<T>(elements, head, lscl, borders, datatype, comm, r, s);
+/* Split the cells of bbox into the non-empty interior cells and all the other cells (ghosts may land in any of them) */
+template<int N>
+void split_interior_cells(
+        const BoundingBox<N>& bbox, Real rc,
+        const algorithm::CellLists<N>* cells,
+        std::vector<Integer>* interior, std::vector<Integer>* border) {
+    const auto lc = get_cell_number_by_dimension<N>(bbox, rc);
+    const Integer n_cells = get_total_cell_number<N>(bbox, rc);
+    interior->clear();
+    border->clear();
+    for(Integer c = 0; c < n_cells; ++c) {
+        if(!is_interior_cell<N>(c, lc)) border->push_back(c);
+        else if(!cells->empty(c)) interior->push_back(c);
+    }
+}
+
+/**
+ * Local elements that may have left their partition since the cell lists were built: those outside the interior
+ * cells. max_displacement bounds the distance an element moved since then, one step by default (less than rc).
+ */
+template<int N>
+void get_migration_candidates(
+        const BoundingBox<N>& bbox, Real rc,
+        const algorithm::CellLists<N>* cells,
+        Integer nb_elements,
+        std::vector<Index>* candidates,
+        Real max_displacement = 0) {
+    const auto lc = get_cell_number_by_dimension<N>(bbox, rc);
+    const Integer n_cells = get_total_cell_number<N>(bbox, rc);
+    const Integer margin = 3 + std::max((Integer) 1, (Integer) std::ceil(max_displacement / rc));
+    candidates->clear();
+    for(Integer c = 0; c < n_cells; ++c) {
+        if(cells->empty(c) || is_interior_cell<N>(c, lc, margin)) continue;
+        cells->for_each(c, [&](Integer p) { if(p < nb_elements) candidates->push_back(p); });
+    }
+}
+
+/**
+ * Collective debug check of a border-only migration: the number of local elements, summed over the PEs, that are
+ * not candidates but no longer belong to the caller (a full scan of the other elements).
+ */
+template<class T, class LoadBalancer, class PointAssignFunc>
+Integer count_missed_migrations(LoadBalancer* LB, const std::vector<T>& data, const std::vector<Index>& candidates,
+                                PointAssignFunc pointAssignFunc, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    std::vector<bool> is_candidate(data.size(), false);
+    for (auto id : candidates) is_candidate[id] = true;
+    std::vector<Index> others;
+    for (Index id = 0; id < (Index) data.size(); ++id) if (!is_candidate[id]) others.push_back(id);
+    std::vector<std::pair<Index, int>> leaving;
+    get_leaving_elements(LB, data, &others, pointAssignFunc, rank, &leaving);
+    Integer missed = leaving.size();
+    MPI_Allreduce(MPI_IN_PLACE, &missed, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    return missed;
+}
+
+/**
+ * Migration of the candidates only (border cells). With check, the other elements are scanned as well and a step
+ * with misses falls back to the full migration.
+ * @return the number of elements the candidates missed, over the PEs (0 without check)
+ */
+template<class T, class LoadBalancer, class PointAssignFunc>
+Integer migrate_border_data(LoadBalancer* LB, std::vector<T>& data, PointAssignFunc pointAssignFunc,
+                            MPI_Datatype datatype, MPI_Comm comm, const std::vector<Index>& candidates,
+                            CommBuffers<T>* buffers, bool check) {
+    if (check) {
+        if (const auto missed = count_missed_migrations(LB, data, candidates, pointAssignFunc, comm)) {
+            migrate_data(LB, data, pointAssignFunc, datatype, comm, nullptr, buffers);
+            return missed;
+        }
+    }
+    migrate_data(LB, data, pointAssignFunc, datatype, comm, &candidates, buffers);
+    return 0;
 }
 #endif //NBMPI_PARALLEL_UTILS_HPP
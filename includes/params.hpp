@@ -37,6 +37,21 @@ struct sim_param_t {
     int   particle_init_conf = 1;
     int   id = 0;
     int nb_best_path;
+    int   force_kernel = 0; /* 0: generic pair functor, 1: batched LJ (SIMD) */
+    int   force_shell  = 0; /* 0: full shell, 1: half shell (Newton's third law) */
+    float verlet_skin  = 0; /* Verlet list skin radius, 0 disables the lists */
+    int   nb_threads   = 1; /* threads per MPI process for the force and integration phase */
+    int   lb_weighting = 0; /* RCB object weights 0: count, 1: interactions, 2: smoothed interactions */
+    int   sfc_order    = 0; /* reordering of the local particles 0: none, 1: Morton, 2: Hilbert */
+    int   sfc_every    = 1; /* reorder at the first neighbour rebuild after this many steps */
+    int   cell_lists   = 0; /* cell lists 0: linked lists (head/lscl), 1: compressed (CSR) */
+    bool  deferred_stats = false; /* reduce the load statistics of a step during the next one */
+    bool  check_migration = false; /* check the border-only migrations against a scan of all the elements */
+    std::string policies; /* load balancing policies to run, see decision_making::PolicyRegistry */
+    float astar_heuristic = 1; /* weight of the A* bound of the remaining cost, 0: uniform cost search */
+    int   astar_groups = 1; /* groups of PEs evaluating the A* nodes concurrently, 1 or 2 */
+    int   snapshot_mem = 0; /* MB of encoded A* frame snapshots per process before spilling to disk, 0: kept as they are */
+    std::string trace_file; /* per-iteration statistics of the runs, empty: not recorded */
     std::string uuid;
     int verbosity;
 };
@@ -56,6 +71,20 @@ void print_params(std::ostream& stream, const sim_param_t& params){
     stream << "= Borders: collisions " << std::endl;
     stream << "= Gravity:  " << params.G << std::endl;
     stream << "= Temperature: " << params.T0 << std::endl;
+    stream << "= Force kernel: " << params.force_kernel << std::endl;
+    stream << "= Cell lists: " << (params.cell_lists ? "compressed" : "linked") << std::endl;
+    stream << "= Force stencil: " << (params.force_shell ? "half shell" : "full shell") << std::endl;
+    stream << "= Verlet skin: " << params.verlet_skin << std::endl;
+    stream << "= Threads per process: " << params.nb_threads << std::endl;
+    stream << "= LB weights: " << params.lb_weighting << std::endl;
+    stream << "= Migration: border cells" << (params.check_migration ? ", checked" : "") << std::endl;
+    stream << "= Load statistics: " << (params.deferred_stats ? "deferred" : "blocking") << std::endl;
+    stream << "= Policies: " << params.policies << std::endl;
+    stream << "= A* heuristic weight: " << params.astar_heuristic << std::endl;
+    stream << "= A* groups: " << params.astar_groups << std::endl;
+    stream << "= A* snapshots: " << (params.snapshot_mem ? std::to_string(params.snapshot_mem) + " MB encoded" : std::string("raw")) << std::endl;
+    stream << "= Trace: " << (params.trace_file.empty() ? "none" : params.trace_file) << std::endl;
+    stream << "= Particle order: " << params.sfc_order << " every " << params.sfc_every << " steps" << std::endl;
     stream << "==============================================" << std::endl;
 }
 void print_params(const sim_param_t& params) {
@@ -69,20 +98,35 @@ std::optional<sim_param_t> get_params(int argc, char** argv){
     parser.add_opt_help('h', "help"); // use -h or --help
 
     parser.add_opt_value('B', "best", params.nb_best_path, 1, "Number of Best path to retrieve (A*)", "INT");
+    parser.add_opt_value('c', "shell", params.force_shell, 0, "Force stencil 0: Full shell, 1: Half shell (Newton's third law)", "INT");
+    parser.add_opt_value('C', "cells", params.cell_lists, 0, "Cell lists 0: Linked lists, 1: Compressed (CSR)", "INT");
     parser.add_opt_value('d', "distribution", params.particle_init_conf, 1, "Initial particle distribution 1: Uniform, 2:Half, 3:Wall, 4: Cluster", "INT");
+    parser.add_opt_flag('D', "deferred-stats", "Reduce the load statistics of a step during the next one (non-blocking)", &params.deferred_stats);
     parser.add_opt_value('e', "epslj", params.eps_lj, 1.0f, "Epsilon (lennard-jones)", "FLOAT");
     parser.add_opt_value('f', "npframe", params.npframe, 100, "steps per frame", "INT").require();
     parser.add_opt_value('F', "nframes", params.nframes, 100, "number of frames", "INT").require();
     parser.add_opt_value('g', "gravitation", params.G, 1.0f, "Gravitational strength", "FLOAT");
+    parser.add_opt_value('G', "astar-groups", params.astar_groups, 1, "Groups of PEs evaluating the two children of an A* node concurrently, only 1 or 2 are supported, the times are scaled to all the PEs", "INT");
+    parser.add_opt_value('H', "heuristic", params.astar_heuristic, 1.0f, "Weight of the A* lower bound of the remaining time (0: uniform cost search, >1: not admissible)", "FLOAT");
     parser.add_opt_value('i', "id", params.id, 0, "Simulation id", "INT").require();
+    parser.add_opt_value('j', "threads", params.nb_threads, 1, "Number of threads per MPI process", "INT");
+    parser.add_opt_value('k', "kernel", params.force_kernel, 0, "Force kernel 0: Generic, 1: Batched LJ (SIMD)", "INT");
+    parser.add_opt_value('K', "skin", params.verlet_skin, 0.0f, "Verlet list skin radius (0: no Verlet lists)", "FLOAT");
     parser.add_opt_value('l', "lattice", params.rc, 3.5f*1e-2f, "Lattice size", "FLOAT");
+    parser.add_opt_flag('m', "check-migration", "Check the border-only migrations against a scan of all the elements and the cuts of the partition against the load balancer (debug)", &params.check_migration);
+    parser.add_opt_value('M', "snapshot-mem", params.snapshot_mem, 0, "Memory (MB) of the delta-encoded A* frame snapshots before spilling to disk (0: uncompressed, in memory)", "INT");
     parser.add_opt_value('n', "nparticles", params.npart, 500, "Number of particles", "INT").require();
-     parser.add_opt_flag('r', "record", "Record the simulation", &params.record);
+    parser.add_opt_value('o', "order", params.sfc_order, 0, "Reorder the local particles along a curve 0: No, 1: Morton, 2: Hilbert", "INT");
+    parser.add_opt_value('O', "order-every", params.sfc_every, 1, "Steps between two reorderings of the local particles", "INT");
+    parser.add_opt_value('P', "policy", params.policies, std::string("menon,procassini,marquez"), "Load balancing policies to run, comma separated name[:value...|:key=value...] (menon, procassini:ratio, marquez:threshold, threshold:imbalance, periodic:period, random:p:seed, file:name, none)", "STRING");
+    parser.add_opt_flag('r', "record", "Record the simulation", &params.record);
+    parser.add_opt_value('R', "trace", params.trace_file, std::string(), "Record the per-iteration statistics of the runs in this file (policy replay)", "FILE");
     parser.add_opt_value('s', "siglj", params.sig_lj, 1e-2f, "Sigma (lennard-jones)", "FLOAT");
     parser.add_opt_value('S', "seed", params.seed, rand(), "Random seed", "INT").require();
     parser.add_opt_value('t', "dt", params.dt, 1e-4f, "Time step", "float");
     parser.add_opt_value('T', "temperature", params.T0, 1.0f, "Initial temperatore", "float");
     parser.add_opt_value('w', "width", params.simsize, 1.0f, "Simulation box width", "FLOAT");
+    parser.add_opt_value('W', "weights", params.lb_weighting, 0, "Load balancing weights 0: Count, 1: Interactions, 2: Smoothed interactions", "INT");
 
     bool output;
     auto &verbose = parser.add_opt_flag('v', "verbose", "Set verbosity", &output);
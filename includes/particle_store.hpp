@@ -0,0 +1,155 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_PARTICLE_STORE_HPP
+#define NBMPI_PARTICLE_STORE_HPP
+
+#include "utils.hpp"
+#include "spatial_elements.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace elements {
+
+    /* allocator returning blocks aligned on Alignment bytes (one cache line / one AVX-512 register by default) */
+    template<class T, size_t Alignment = 64>
+    struct aligned_allocator {
+        using value_type = T;
+        template<class U> struct rebind { using other = aligned_allocator<U, Alignment>; };
+
+        aligned_allocator() = default;
+        template<class U> constexpr aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept {}
+
+        T* allocate(size_t n) {
+            const size_t bytes = ((n * sizeof(T) + Alignment - 1) / Alignment) * Alignment;
+            if (void* p = std::aligned_alloc(Alignment, bytes)) return static_cast<T*>(p);
+            throw std::bad_alloc();
+        }
+        void deallocate(T* p, size_t) noexcept { std::free(p); }
+
+        template<class U> bool operator==(const aligned_allocator<U, Alignment>&) const noexcept { return true; }
+        template<class U> bool operator!=(const aligned_allocator<U, Alignment>&) const noexcept { return false; }
+    };
+
+    template<class T>
+    using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+    /**
+     * Structure-of-arrays storage of particles: one aligned array per coordinate of the position and of the velocity,
+     * plus the ids. The local particles come first and may be followed by the ghosts, such that j indexes the same
+     * particle as in the cell lists (j < n_local: local, otherwise ghost).
+     * Element<N> records remain the exchange format of the local particles (Zoltan pack/unpack, MPI datatype), the
+     * store is loaded from and written back to them; the ghosts may be position-only records (Ghost<N>).
+     */
+    template<int N>
+    class ParticleStore {
+        std::array<aligned_vector<Real>, N> pos, vel;
+        aligned_vector<Index> gids, lids;
+    public:
+        using value_type = Element<N>;
+
+        size_t size()  const { return gids.size(); }
+        bool   empty() const { return gids.empty(); }
+
+        void clear()  { resize(0); }
+
+        void reserve(size_t n) {
+            for (int dim = 0; dim < N; ++dim) { pos[dim].reserve(n); vel[dim].reserve(n); }
+            gids.reserve(n); lids.reserve(n);
+        }
+
+        void resize(size_t n) {
+            for (int dim = 0; dim < N; ++dim) { pos[dim].resize(n); vel[dim].resize(n); }
+            gids.resize(n); lids.resize(n);
+        }
+
+        void push_back(const Element<N>& e) {
+            for (int dim = 0; dim < N; ++dim) { pos[dim].push_back(e.position[dim]); vel[dim].push_back(e.velocity[dim]); }
+            gids.push_back(e.gid); lids.push_back(e.lid);
+        }
+
+        void pop_back() {
+            for (int dim = 0; dim < N; ++dim) { pos[dim].pop_back(); vel[dim].pop_back(); }
+            gids.pop_back(); lids.pop_back();
+        }
+
+        Element<N> get(size_t i) const {
+            Element<N> e;
+            for (int dim = 0; dim < N; ++dim) { e.position[dim] = pos[dim][i]; e.velocity[dim] = vel[dim][i]; }
+            e.gid = gids[i]; e.lid = lids[i];
+            return e;
+        }
+
+        void set(size_t i, const Element<N>& e) {
+            for (int dim = 0; dim < N; ++dim) { pos[dim][i] = e.position[dim]; vel[dim][i] = e.velocity[dim]; }
+            gids[i] = e.gid; lids[i] = e.lid;
+        }
+
+        Element<N> operator[](size_t i) const { return get(i); }
+
+        std::array<Real, N> position(size_t i) const {
+            std::array<Real, N> p;
+            for (int dim = 0; dim < N; ++dim) p[dim] = pos[dim][i];
+            return p;
+        }
+
+        Real*       x(int dim)       { return pos[dim].data(); }
+        const Real* x(int dim) const { return pos[dim].data(); }
+        Real*       v(int dim)       { return vel[dim].data(); }
+        const Real* v(int dim) const { return vel[dim].data(); }
+        Index&      gid(size_t i)       { return gids[i]; }
+        Index       gid(size_t i) const { return gids[i]; }
+        Index&      lid(size_t i)       { return lids[i]; }
+        Index       lid(size_t i) const { return lids[i]; }
+
+        /* gather the local records followed by the positions of the ghosts */
+        template<class T, class G, class GetPosPtrFunc, class GetVelPtrFunc>
+        void load(const std::vector<T>& local, const std::vector<G>& remote, GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr) {
+            resize(0);
+            append(local, getPosPtr, getVelPtr);
+            append_ghosts(remote, getPosPtr);
+        }
+
+        /* gather the records after the particles already stored (e.g. the ghosts once they have arrived) */
+        template<class T, class GetPosPtrFunc, class GetVelPtrFunc>
+        void append(const std::vector<T>& records, GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr) {
+            size_t i = size();
+            resize(i + records.size());
+            for (const auto& el : records) {
+                const auto& p = *getPosPtr(const_cast<T&>(el));
+                const auto& v = *getVelPtr(const_cast<T&>(el));
+                for (int dim = 0; dim < N; ++dim) { pos[dim][i] = p[dim]; vel[dim][i] = v[dim]; }
+                gids[i] = el.gid; lids[i] = el.lid;
+                i++;
+            }
+        }
+
+        /* gather the positions of the ghosts after the particles already stored, their velocity and ids are unused */
+        template<class G, class GetPosPtrFunc>
+        void append_ghosts(const std::vector<G>& ghosts, GetPosPtrFunc getPosPtr) {
+            size_t i = size();
+            resize(i + ghosts.size());
+            for (const auto& g : ghosts) {
+                const auto& p = *getPosPtr(const_cast<G&>(g));
+                for (int dim = 0; dim < N; ++dim) { pos[dim][i] = p[dim]; vel[dim][i] = 0; }
+                gids[i] = lids[i] = -1;
+                i++;
+            }
+        }
+
+        /* scatter the positions and velocities of the first local.size() particles back to the records */
+        template<class T, class GetPosPtrFunc, class GetVelPtrFunc>
+        void store(std::vector<T>& local, GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr) const {
+            for (size_t i = 0; i < local.size(); ++i) {
+                auto& p = *getPosPtr(local[i]);
+                auto& v = *getVelPtr(local[i]);
+                for (int dim = 0; dim < N; ++dim) { p[dim] = pos[dim][i]; v[dim] = vel[dim][i]; }
+            }
+        }
+    };
+}
+#endif //NBMPI_PARTICLE_STORE_HPP
@@ -6,6 +6,10 @@
 #define NBMPI_PHYSICS_HPP
 
 #include <limits>
+#include <algorithm>
+
+#include "params.hpp"
+#include "particle_store.hpp"
 
 Real compute_LJ_scalar(Real r2, Real eps, Real sig2) {
     if (r2 < 6.25 * sig2) { /* r_cutoff = 2.5 *sigma */
@@ -18,11 +22,13 @@ Real compute_LJ_scalar(Real r2, Real eps, Real sig2) {
 
 template<int N, class T, class GetPosPtrFunc, class GetVelPtrFunc>
 void leapfrog1(const Real dt, const Real cut_off, const std::vector<Real>& acc, std::vector<T>& elements
-        ,GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr) {
-    int i = 0;
+        ,GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr
+        ,size_t begin = 0, size_t end = std::numeric_limits<size_t>::max()) {
     constexpr Real two = 2.0;
     constexpr Real maxSpeedPercentage = 0.9;
-    for(auto &el : elements){
+    end = std::min(end, elements.size());
+    for(size_t i = begin; i < end; ++i){
+        auto &el = elements[i];
         std::array<Real, N>* pos = getPosPtr(el);//(getPosFunc(el));
         std::array<Real, N>* vel = getVelPtr(el);//(getVelFunc(el));
         for(size_t dim = 0; dim < N; ++dim) {
@@ -44,15 +50,15 @@ void leapfrog1(const Real dt, const Real cut_off, const std::vector<Real>& acc,
 
 
 template<int N, class T, class GetVelPtrFunc>
-void leapfrog2(const Real dt, const std::vector<Real>& acc, std::vector<T>& elements, GetVelPtrFunc getVelPtr) {
-    int i = 0;
+void leapfrog2(const Real dt, const std::vector<Real>& acc, std::vector<T>& elements, GetVelPtrFunc getVelPtr
+        ,size_t begin = 0, size_t end = std::numeric_limits<size_t>::max()) {
     constexpr Real two = 2.0;
-    for(auto &el : elements){
-        std::array<Real, N>* vel = getVelPtr(el); //getVelFunc(el);
+    end = std::min(end, elements.size());
+    for(size_t i = begin; i < end; ++i){
+        std::array<Real, N>* vel = getVelPtr(elements[i]); //getVelFunc(el);
         for(size_t dim = 0; dim < N; ++dim) {
             vel->at(dim) += acc.at(N*i+dim) * dt / two;
         }
-        i++;
     }
 }
 
@@ -70,9 +76,11 @@ void reflect(Real wall, Real* x, Real* v) {
 }
 
 template<int N, class T, class GetPosPtrFunc, class GetVelPtrFunc>
-void apply_reflect(std::vector<T> &elements, const Real simsize, GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr) {
-
-    for(auto &element: elements) {
+void apply_reflect(std::vector<T> &elements, const Real simsize, GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr
+        ,size_t begin = 0, size_t end = std::numeric_limits<size_t>::max()) {
+    end = std::min(end, elements.size());
+    for(size_t i = begin; i < end; ++i) {
+        auto &element = elements[i];
         size_t dim = 0;
         std::array<Real, N>* pos  = getPosPtr(element);
         std::array<Real, N>* vel  = getVelPtr(element);
@@ -85,4 +93,61 @@ void apply_reflect(std::vector<T> &elements, const Real simsize, GetPosPtrFunc g
         }
     }
 }
+
+namespace integrators {
+    /**
+     * leapfrog2, leapfrog1 and apply_reflect fused: both half kicks with the forces of the step, the speed clamp, the
+     * drift and the wall reflection of one coordinate of one particle. Branch free, so that a sweep over contiguous
+     * arrays vectorizes.
+     * An integrator is any functor constructible from the simulation parameters and callable as
+     * f(position, velocity, acceleration) on one coordinate, see integrate.
+     */
+    struct Leapfrog {
+        Real dt, cut_off, simsize;
+
+        explicit Leapfrog(const sim_param_t& params) : dt(params.dt), cut_off(params.rc), simsize(params.simsize) {}
+
+        inline void operator()(Real& x, Real& v, Real a) const {
+            constexpr Real two = 2.0;
+            constexpr Real maxSpeedPercentage = 0.9;
+            const Real wall = simsize - std::numeric_limits<Real>::epsilon();
+            v += a * dt / two;
+            v += a * dt / two;
+            v  = std::abs(v * dt) >= cut_off ? maxSpeedPercentage * cut_off / dt : v;
+            x += v * dt;
+            const bool below = x < (Real) 0.0;
+            x  = below ? -x : x;
+            v  = below ? -v : v;
+            const bool above = x >= simsize;
+            x  = above ? two * wall - x : x;
+            v  = above ? -v : v;
+        }
+    };
+}
+
+/* One sweep of integrator over the particles [begin, end) of the store, one contiguous array per coordinate */
+template<int N, class Integrator>
+void integrate(const Integrator& integrator, const std::vector<Real>& acc, elements::ParticleStore<N>& store,
+               size_t begin, size_t end) {
+    for(size_t dim = 0; dim < N; ++dim) {
+        Real* x = store.x(dim);
+        Real* v = store.v(dim);
+        const Real* a = acc.data();
+        for(size_t i = begin; i < end; ++i) integrator(x[i], v[i], a[N*i+dim]);
+    }
+}
+
+/* One sweep of integrator over the elements [begin, end) */
+template<int N, class T, class Integrator, class GetPosPtrFunc, class GetVelPtrFunc>
+void integrate(const Integrator& integrator, const std::vector<Real>& acc, std::vector<T>& elements,
+               GetPosPtrFunc getPosPtr, GetVelPtrFunc getVelPtr,
+               size_t begin = 0, size_t end = std::numeric_limits<size_t>::max()) {
+    end = std::min(end, elements.size());
+    const Real* a = acc.data();
+    for(size_t i = begin; i < end; ++i) {
+        auto& pos = *getPosPtr(elements[i]);
+        auto& vel = *getVelPtr(elements[i]);
+        for(size_t dim = 0; dim < N; ++dim) integrator(pos[dim], vel[dim], a[N*i+dim]);
+    }
+}
 #endif //NBMPI_PHYSICS_HPP
@@ -13,9 +13,12 @@
 #include <unordered_map>
 #include <zoltan.h>
 #include <cstdlib>
+#include <numeric>
+#include <stdexcept>
 
 #include "../decision_makers/strategy.hpp"
 #include "../ljpotential.hpp"
+#include "../lb_weights.hpp"
 #include "../physics.hpp"
 #include "../nbody_io.hpp"
 #include "../utils.hpp"
@@ -24,6 +27,8 @@
 #include "../zoltan_fn.hpp"
 #include "../astar.hpp"
 #include "../parallel_utils.hpp"
+#include "../trace.hpp"
+#include "../snapshot_store.hpp"
 
 #include "spdlog/spdlog.h"
 #include "spdlog/sinks/basic_file_sink.h"
@@ -40,7 +45,8 @@ std::tuple<LBSolutionPath, LBLiHist, LBDecHist, TimeHistory> simulate_using_shor
             Wrapper fWrapper,
             sim_param_t *params,
             MPI_Datatype datatype,
-            MPI_Comm comm = MPI_COMM_WORLD) {
+            MPI_Comm comm = MPI_COMM_WORLD,
+            trace::TraceRecorder* recorder = nullptr) {
 
     int nproc, rank;
     MPI_Comm_rank(comm, &rank);
@@ -60,33 +66,261 @@ std::tuple<LBSolutionPath, LBLiHist, LBDecHist, TimeHistory> simulate_using_shor
     std::vector<T> recv_buf(params->npart);
 
     std::vector<Time> times(nproc), my_frame_times(nframes);
-    std::vector<Index> lscl(mesh_data->els.size()), head;
+    std::vector<Index> migration_candidates;
+    Integer missed_migrations = 0; // elements the border-only migrations missed (check_migration)
+    algorithm::CellLists<N> cells(params->cell_lists);
+    // Scratch memory of the force kernels (thread buffers, SOA_PARTICLE_STORE copy), reused by every step
+    lj::Workspace<N> step_workspace;
+    CommBuffers<T> migration_buffers;
     std::vector<Complexity> my_frame_cmplx(nframes);
 
     const int nb_data = mesh_data->els.size();
     for(int i = 0; i < nb_data; ++i) mesh_data->els[i].lid = i;
 
+    /**
+     * The PEs are split into groups, each one simulating all the particles with its own load balancer, so that the
+     * children of a node are evaluated at the same time (one per group). A group evaluates its children and
+     * computes the partition of the balanced sibling it does not evaluate; the peers (same rank in every group)
+     * then exchange the results. The search is the same on every PE.
+     * A node has at most two children and the snapshots of a group are those of the nodes it evaluated, so at most
+     * two groups are supported: a third group would have no node to evaluate and no state to expand from.
+     */
+    const int nb_groups = std::max(1, params->astar_groups);
+    if(nb_groups > 2 || nproc % nb_groups)
+        throw std::runtime_error("A*: the PEs can be split into 1 or 2 groups of the same size");
+    const int group = rank / (nproc / nb_groups);
+    MPI_Comm search_comm = comm, peer_comm = MPI_COMM_SELF;
+    Zoltan_Struct* search_lb = load_balancer;
+    MESH_DATA<T> search_data;
+    if(nb_groups > 1) {
+        MPI_Comm_split(comm, group, rank, &search_comm);
+        MPI_Comm_split(comm, rank % (nproc / nb_groups), group, &peer_comm);
+        // every group holds all the particles
+        int nlocal = mesh_data->els.size();
+        std::vector<int> counts(nb_groups), displs(nb_groups, 0);
+        MPI_Allgather(&nlocal, 1, MPI_INT, counts.data(), 1, MPI_INT, peer_comm);
+        std::partial_sum(counts.cbegin(), counts.cend() - 1, displs.begin() + 1);
+        search_data.els.resize(displs.back() + counts.back());
+        MPI_Allgatherv(mesh_data->els.data(), nlocal, datatype, search_data.els.data(), counts.data(), displs.data(), datatype, peer_comm);
+        for(size_t i = 0; i < search_data.els.size(); ++i) search_data.els[i].lid = i;
+        search_lb = zoltan_create_wrapper(search_comm);
+        Zoltan_Do_LB<N>(&search_data, search_lb);
+        // no trace, the timings of a group are not those of the application
+        recorder = nullptr;
+    } else {
+        search_data = *mesh_data;
+    }
+    // with smoothed weights, two nodes in the same state may have different partitions
+    if(params->lb_weighting == 2) recorder = nullptr;
+    int search_nproc, search_rank;
+    MPI_Comm_rank(search_comm, &search_rank);
+    MPI_Comm_size(search_comm, &search_nproc);
+
+    // Iteration times reduced in one collective per step, the load balancing time is charged to the step that balanced
+    LoadStatistics load_stats(search_comm);
+
+    /* average of the slowest iteration time over a few steps from data, without load balancing; data is advanced */
+    auto calibrate = [&](MESH_DATA<T>& data, Zoltan_Struct* zz, MPI_Comm c) {
+        const int nb_steps = std::min(npframe, 10);
+        BorderCache<N> border_cache;
+        migrate_data(zz, data.els, pointAssignFunc, datatype, c);
+        auto bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, data.els);
+        auto borders   = border_cache.get(zz, bbox, params->rc, boxIntersectFunc, c);
+        auto remote_el = get_ghost_data<N>(data.els, getPosPtrFunc, &cells, bbox, borders, params->rc, datatype, c);
+        Time total = 0;
+        for (int i = 0; i < nb_steps; ++i) {
+            START_TIMER(it_time);
+            lj::compute_one_step<N>(data.els, remote_el, getPosPtrFunc, getVelPtrFunc, &cells, bbox, getForceFunc, borders, params, nullptr, (SparseExchange<T>*) nullptr, &step_workspace);
+            END_TIMER(it_time);
+            MPI_Allreduce(MPI_IN_PLACE, &it_time, 1, MPI_TIME, MPI_MAX, c);
+            total += it_time;
+            migrate_data(zz, data.els, pointAssignFunc, datatype, c);
+            bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, data.els);
+            borders   = border_cache.get(zz, bbox, params->rc, boxIntersectFunc, c);
+            remote_el = get_ghost_data<N>(data.els, getPosPtrFunc, &cells, bbox, borders, params->rc, datatype, c);
+        }
+        return total / nb_steps;
+    };
+    // the times measured by a group are brought to the time scale of all the PEs
+    Time time_scale = 1.0;
+    if(nb_groups > 1) {
+        // the particles of mesh_data are not used by the search, those of a group are its initial state
+        const Time full_time = calibrate(*mesh_data, load_balancer, comm);
+        MESH_DATA<T> group_data;
+        group_data.els = search_data.els;
+        Time group_time = calibrate(group_data, search_lb, search_comm);
+        MPI_Allreduce(MPI_IN_PLACE, &group_time, 1, MPI_TIME, MPI_SUM, peer_comm);
+        time_scale = full_time / (group_time / nb_groups);
+        if(!rank) std::cout << "A*: " << nb_groups << " groups of " << search_nproc << " PEs, time scale " << time_scale << std::endl;
+    }
+
     using TNode = Node;
     std::vector<std::shared_ptr<TNode>> container;
     container.reserve((unsigned long) std::pow(2, 20));
     using PriorityQueue = std::multiset<std::shared_ptr<TNode>, Compare>;
     PriorityQueue pQueue;
-    pQueue.insert(std::make_shared<Node>(load_balancer, -npframe, npframe, DoLB));
+    {
+        auto root = std::make_shared<Node>(partitioning::CutTree::from(search_lb, search_nproc), -npframe, npframe, DoLB, search_comm);
+        pQueue.insert(root);
+    }
 
     std::vector<std::shared_ptr<Node>> solutions;
     std::vector<bool> foundYes(nframes+1, false);
-    std::vector<MESH_DATA<T>> rollback_data(nframes+1);
-    std::for_each(rollback_data.begin(), rollback_data.end(), [mesh_data](auto& vec){vec.els.reserve(mesh_data->els.size());});
+    // State of the particles at every frame, compressed and spilled to disk above the memory budget
+    const char* tmpdir = std::getenv("TMPDIR");
+    snapshot::SnapshotStore<T> rollback_data(nframes+1, (long long) params->snapshot_mem << 20,
+            std::string(tmpdir ? tmpdir : "/tmp") + "/nbmpi_snapshots_" + std::to_string(params->id) + "_" + std::to_string(rank));
+    rollback_data.reserve(search_data.els.size());
+    rollback_data.store(0, std::move(search_data.els));
+
+    // Nodes are ordered by their cost plus a lower bound of the remaining cost, the same on every PE
+    RemainingCostBound bound(nb_iterations, params->astar_heuristic);
+    SearchStatistics search;
+
+    /* simulate the node from the state of its parent, mirror: balanced sibling whose partition is computed only */
+    auto evaluate_node = [&](const std::shared_ptr<Node>& currentNode, const std::shared_ptr<Node>& node, const std::shared_ptr<Node>& mirror) {
+        const auto frame      = currentNode->end_it / npframe;
+        const auto next_frame = frame + 1;
+        /* compute node cost */
+        Time comp_time = 0.0;
+
+        Time starting_time = currentNode->cost();
+
+        MESH_DATA<T> mesh_data;
+        rollback_data.restore(frame, &mesh_data.els);
+        auto load_balancer = node->partition.get();
+
+        auto& cum_li_hist = node->li_slowdown_hist;
+        auto& time_hist   = node->time_hist;
+        auto& dec_hist    = node->dec_hist;
+        auto& probe    = node->stats;
+
+        // Move data according to my parent's state
+        migrate_data(load_balancer, mesh_data.els, pointAssignFunc, datatype, search_comm);
+        // Compute my bounding box as function of my local data
+        auto bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, mesh_data.els);
+        // Compute which cells are on my borders, the partition of the node only changes when it balances
+        BorderCache<N> border_cache;
+        auto borders   = border_cache.get(load_balancer, bbox, params->rc, boxIntersectFunc, search_comm);
+        // Get the ghost data from neighboring processors
+        auto remote_el = get_ghost_data<N>(mesh_data.els, getPosPtrFunc, &cells, bbox, borders, params->rc, datatype, search_comm);
+
+        // state of the partition for the trace: the last balancing along the path to this node
+        Integer lb_iteration = -1;
+        for (auto n = currentNode; n; n = n->parent)
+            if (n->decision == DoLB) { lb_iteration = n->start_it; break; }
+        for (int i = 0; i < node->batch_size; ++i) {
+            const Integer iteration = node->start_it + i;
+            START_TIMER(it_compute_time);
+            const auto it_complexity = lj::compute_one_step<N>(mesh_data.els, remote_el, getPosPtrFunc, getVelPtrFunc, &cells, bbox, getForceFunc, borders,  params, nullptr, (SparseExchange<T>*) nullptr, &step_workspace);
+            END_TIMER(it_compute_time);
+            const Time local_compute_time = it_compute_time;
+
+            // Measure load imbalance
+            IterationLoad load;
+            load_stats.reduce(it_compute_time * time_scale, 0.0, &load);
+            probe.set_iteration_times(load.max_it, load.min_it, load.sum_it);
+            bound.update(load.sum_it / search_nproc);
+            probe.update_cumulative_imbalance_time();
+            it_compute_time = load.max_it;
+
+            if(currentNode->decision == DoLB) {
+                probe.update_lb_parallel_efficiencies();
+            }
 
-    rollback_data[0] = *mesh_data;
+            cum_li_hist[i] = probe.get_cumulative_imbalance_time();
+            dec_hist[i]    = node->decision == DoLB && i == 0;
+            if (mirror && i == 0) {
+                // the sibling is evaluated by another group, off the clock, its weights follow its own path
+                ObjectWeights<N> lb_weights(params->lb_weighting);
+                lb_weights.set_history(mirror->weight_history);
+                lb_weights.compute(mesh_data.els, bbox, params->rc, &cells, &mesh_data.weights);
+                mirror->weight_history = lb_weights.get_history();
+                Zoltan_Compute_Partition<N>(&mesh_data, search_lb);
+                mirror->partition = partitioning::CutTree::from(search_lb, search_nproc);
+                mesh_data.weights.clear();
+            }
+            Time local_lb_time = 0;
+            if (node->decision == DoLB && i == 0) {
+                PAR_START_TIMER(lb_time_spent, search_comm);
+                // the smoothed weights follow the load balancing calls along the path to the node
+                ObjectWeights<N> lb_weights(params->lb_weighting);
+                lb_weights.set_history(node->weight_history);
+                lb_weights.compute(mesh_data.els, bbox, params->rc, &cells, &mesh_data.weights);
+                node->weight_history = lb_weights.get_history();
+                Zoltan_Do_LB<N>(&mesh_data, search_lb);
+                node->partition = partitioning::CutTree::from(search_lb, search_nproc);
+                load_balancer = node->partition.get();
+                border_cache.invalidate();
+                PAR_END_TIMER(lb_time_spent, search_comm);
+                local_lb_time = lb_time_spent;
+                MPI_Allreduce(MPI_IN_PLACE, &lb_time_spent, 1, MPI_TIME, MPI_MAX, search_comm);
+                lb_time_spent *= time_scale;
+                probe.push_load_balancing_time(lb_time_spent);
+                probe.reset_cumulative_imbalance_time();
+                it_compute_time += lb_time_spent;
+            } else {
+                get_migration_candidates<N>(bbox, params->rc, &cells, mesh_data.els.size(), &migration_candidates);
+                missed_migrations += migrate_border_data(load_balancer, mesh_data.els, pointAssignFunc, datatype, search_comm, migration_candidates, &migration_buffers, params->check_migration);
+            }
+            if (recorder) {
+                const bool balanced = node->decision == DoLB && i == 0;
+                recorder->iteration(iteration, lb_iteration, local_compute_time, it_complexity,
+                                    balanced ? 0 : migration_buffers.nb_elements_sent());
+                if (balanced) recorder->load_balancing(iteration, lb_iteration, local_lb_time);
+            }
+            if (node->decision == DoLB && i == 0) lb_iteration = iteration;
+            time_hist[i]   = i == 0 ? starting_time + it_compute_time : time_hist[i-1] + it_compute_time;
+
+            bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, mesh_data.els);
+            borders   = border_cache.get(load_balancer, bbox, params->rc, boxIntersectFunc, search_comm);
+            remote_el = get_ghost_data<N>(mesh_data.els, getPosPtrFunc, &cells, bbox, borders, params->rc, datatype, search_comm);
+            comp_time += it_compute_time;
+        }
+        if(node->end_it < nb_iterations)
+            rollback_data.store(next_frame, std::move(mesh_data.els));
+        MPI_Barrier(search_comm);
+        return comp_time;
+    };
+
+    /* the owner group sends the results of the node to the other groups, @return the cost of the node */
+    auto share_node = [&](const std::shared_ptr<Node>& node, int owner, Time comp_time) {
+        if(nb_groups == 1) return comp_time;
+        std::vector<double> buf;
+        if(group == owner) {
+            const auto probe = node->stats.pack();
+            buf.push_back(comp_time);
+            buf.insert(buf.end(), node->li_slowdown_hist.cbegin(), node->li_slowdown_hist.cend());
+            buf.insert(buf.end(), node->dec_hist.cbegin(), node->dec_hist.cend());
+            buf.insert(buf.end(), node->time_hist.cbegin(), node->time_hist.cend());
+            buf.insert(buf.end(), probe.cbegin(), probe.cend());
+        }
+        int size = buf.size();
+        MPI_Bcast(&size, 1, MPI_INT, owner, peer_comm);
+        buf.resize(size);
+        MPI_Bcast(buf.data(), size, MPI_DOUBLE, owner, peer_comm);
+        if(group != owner) {
+            const auto batch_size = node->batch_size;
+            const double* it = buf.data() + 1;
+            std::copy(it, it + batch_size, node->li_slowdown_hist.begin()); it += batch_size;
+            std::copy(it, it + batch_size, node->dec_hist.begin());         it += batch_size;
+            std::copy(it, it + batch_size, node->time_hist.begin());        it += batch_size;
+            node->stats.unpack(it);
+        }
+        return buf[0];
+    };
 
     while(solutions.size() < nb_solution_wanted) {
         std::shared_ptr<Node> currentNode = *pQueue.begin();
         pQueue.erase(pQueue.begin());
+        search.expanded++;
         if(!rank ) std::cout << currentNode << std::endl;
         //Ok, I found a Yes Node for a given depth of the binary tree, no other Yes node at this depth can be better
+        //(the nodes of a depth share the same bound, their order is that of their cost)
         if(currentNode->decision == DoLB && currentNode->start_it > 0) {
+            const auto before = pQueue.size();
             prune_similar_nodes(currentNode, pQueue);
+            search.pruned += before - pQueue.size();
             foundYes.at(currentNode->start_it / npframe) = true;
         }
 
@@ -94,77 +328,41 @@ std::tuple<LBSolutionPath, LBLiHist, LBDecHist, TimeHistory> simulate_using_shor
             solutions.push_back(currentNode);
             break;
         } else {
-            auto children = currentNode->get_children();
-            for(std::shared_ptr<Node> node : children) {
-                const auto frame      = currentNode->end_it / npframe;
-                const auto next_frame = frame + 1;
-                if(node && ((node->decision == DontLB) || (node->decision == DoLB && !foundYes.at(frame)))) {
-                    /* compute node cost */
-                    Time comp_time = 0.0;
-
-                    Time starting_time = currentNode->cost();
-
-                    auto mesh_data     = rollback_data.at(frame);
-                    auto load_balancer = node->lb;
-
-                    auto& cum_li_hist = node->li_slowdown_hist;
-                    auto& time_hist   = node->time_hist;
-                    auto& dec_hist    = node->dec_hist;
-                    auto& probe    = node->stats;
-
-                    // Move data according to my parent's state
-                    migrate_data(load_balancer, mesh_data.els, pointAssignFunc, datatype, comm);
-                    // Compute my bounding box as function of my local data
-                    auto bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, mesh_data.els);
-                    // Compute which cells are on my borders
-                    auto borders   = get_border_cells_index<N>(load_balancer, bbox, params->rc, boxIntersectFunc, comm);
-                    // Get the ghost data from neighboring processors
-                    auto remote_el = get_ghost_data<N>(mesh_data.els, getPosPtrFunc, &head, &lscl, bbox, borders, params->rc, datatype, comm);
-
-                    for (int i = 0; i < node->batch_size; ++i) {
-                        START_TIMER(it_compute_time);
-                        lj::compute_one_step<N>(mesh_data.els, remote_el, getPosPtrFunc, getVelPtrFunc, &head, &lscl, bbox, getForceFunc, borders,  params);
-                        END_TIMER(it_compute_time);
-
-                        // Measure load imbalance
-                        MPI_Allreduce(&it_compute_time, probe.max_it_time(), 1, MPI_TIME, MPI_MAX, comm);
-                        MPI_Allreduce(&it_compute_time, probe.sum_it_time(), 1, MPI_TIME, MPI_SUM, comm);
-                        probe.update_cumulative_imbalance_time();
-                        it_compute_time = *probe.max_it_time();
-
-                        if(currentNode->decision == DoLB) {
-                            probe.update_lb_parallel_efficiencies();
-                        }
-
-                        cum_li_hist[i] = probe.get_cumulative_imbalance_time();
-                        dec_hist[i]    = node->decision == DoLB && i == 0;
-                        if (node->decision == DoLB && i == 0) {
-                            PAR_START_TIMER(lb_time_spent, MPI_COMM_WORLD);
-                            Zoltan_Do_LB<N>(&mesh_data, load_balancer);
-                            PAR_END_TIMER(lb_time_spent, MPI_COMM_WORLD);
-                            MPI_Allreduce(MPI_IN_PLACE, &lb_time_spent,  1, MPI_TIME, MPI_MAX, comm);
-                            probe.push_load_balancing_time(lb_time_spent);
-                            probe.reset_cumulative_imbalance_time();
-                            it_compute_time += lb_time_spent;
-                        } else {
-                            migrate_data(load_balancer, mesh_data.els, pointAssignFunc, datatype, comm);
-                        }
-                        time_hist[i]   = i == 0 ? starting_time + it_compute_time : time_hist[i-1] + it_compute_time;
-
-                        bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, mesh_data.els);
-                        borders   = get_border_cells_index<N>(load_balancer, bbox, params->rc, boxIntersectFunc, comm);
-                        remote_el = get_ghost_data<N>(mesh_data.els, getPosPtrFunc, &head, &lscl, bbox, borders, params->rc, datatype, comm);
-                        comp_time += it_compute_time;
-                    }
-                    node->set_cost(comp_time);
-                    pQueue.insert(node);
-                    if(node->end_it < nb_iterations)
-                        rollback_data.at(next_frame) = mesh_data;
-                }
-                MPI_Barrier(comm);
+            const auto frame = currentNode->end_it / npframe;
+            std::vector<std::shared_ptr<Node>> children;
+            for(std::shared_ptr<Node> node : currentNode->get_children()) {
+                if(node && node->decision == DoLB && foundYes.at(frame)) search.skipped++;
+                else if(node) children.push_back(node);
+            }
+            search.simulated += children.size();
+            const Time best_it_time = bound.best_it_time;
+            if(nb_groups == 1 || children.size() == 1) {
+                // a lone child is evaluated by every group
+                for(auto& node : children) node->set_cost(share_node(node, 0, evaluate_node(currentNode, node, nullptr)));
+            } else {
+                // one child per group, the group of the child that does not balance computes the partition of the other
+                std::vector<Time> comp_times(children.size(), 0.0);
+                const auto& sibling = children[1 - group];
+                comp_times[group] = evaluate_node(currentNode, children[group], sibling->decision == DoLB ? sibling : nullptr);
+                for(int owner = 0; owner < nb_groups; ++owner)
+                    children[owner]->set_cost(share_node(children[owner], owner, comp_times[owner]));
+            }
+            if(nb_groups > 1) MPI_Allreduce(MPI_IN_PLACE, &bound.best_it_time, 1, MPI_TIME, MPI_MIN, peer_comm);
+            for(auto& node : children) {
+                node->heuristic = bound(*node);
+                pQueue.insert(node);
             }
+            if(bound.best_it_time < best_it_time) {
+                update_heuristics(pQueue, bound);
+                search.reordered++;
+            }
+            search.max_queue_size = std::max(search.max_queue_size, pQueue.size());
         }
     }
+    if(!rank) std::cout << search << std::endl;
+    if(!rank && params->snapshot_mem)
+        std::cout << "A* snapshots: " << rollback_data.get_encoded_bytes() << " bytes encoded for " << rollback_data.get_raw_bytes()
+                  << " bytes of particles, " << rollback_data.get_nb_spilled() << " blocks spilled" << std::endl;
 
     LBSolutionPath solution_path;
     LBLiHist cumulative_load_imbalance;
@@ -195,7 +393,7 @@ std::tuple<LBSolutionPath, LBLiHist, LBDecHist, TimeHistory> simulate_using_shor
     if(params->record){
         SimpleCSVFormatter frame_formater(',');
         for(int frame = 0; frame < params->nframes+1; ++frame){
-            gather_elements_on(nproc, rank, params->npart, rollback_data[frame].els, 0, recv_buf, datatype, comm);
+            gather_elements_on(search_nproc, search_rank, params->npart, rollback_data.view(frame), 0, recv_buf, datatype, search_comm);
 
             if (!rank) {
                 auto particle_logger = spdlog::basic_logger_mt("particle_logger", "logs/"+std::to_string(params->seed)+"/frames_bab/particles.csv."+std::to_string(frame));
@@ -209,6 +407,15 @@ std::tuple<LBSolutionPath, LBLiHist, LBDecHist, TimeHistory> simulate_using_shor
         }
     }
 
+    if(params->check_migration && !rank)
+        std::cout << "A* border-only migration: " << missed_migrations << " elements missed (full migration instead)" << std::endl;
+
+    if(nb_groups > 1) {
+        Zoltan_Destroy(&search_lb);
+        MPI_Comm_free(&search_comm);
+        MPI_Comm_free(&peer_comm);
+    }
+
     return {solution_path, cumulative_load_imbalance, decisions, time_hist};
 }
 #endif //NBMPI_SHORTEST_PATH_HPP
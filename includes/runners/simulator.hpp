@@ -12,13 +12,18 @@
 #include <map>
 #include <unordered_map>
 #include <cstdlib>
+#include <optional>
+#include <random>
 
 #include "../decision_makers/strategy.hpp"
 
 #include "../ljpotential.hpp"
+#include "../lb_weights.hpp"
+#include "../spatial_sort.hpp"
 #include "../nbody_io.hpp"
 #include "../utils.hpp"
 #include "../parallel_utils.hpp"
+#include "../trace.hpp"
 
 #include "../params.hpp"
 
@@ -44,7 +49,8 @@ std::tuple<ApplicationTime, CumulativeLoadImbalanceHistory, Decisions, TimeHisto
               Probe* probe,
               MPI_Datatype datatype,
               const MPI_Comm comm = MPI_COMM_WORLD,
-              const std::string output_names_prefix = "") {
+              const std::string output_names_prefix = "",
+              trace::TraceRecorder* recorder = nullptr) {
 
     auto boxIntersectFunc   = fWrapper.getBoxIntersectionFunc();
     auto doLoadBalancingFunc= fWrapper.getLoadBalancingFunc();
@@ -83,15 +89,72 @@ std::tuple<ApplicationTime, CumulativeLoadImbalanceHistory, Decisions, TimeHisto
     }
 
     std::vector<Time> times(nproc), my_frame_times(nframes);
-    std::vector<Index> lscl(mesh_data->els.size()), head;
+    std::vector<Index> migration_candidates;
+    Integer missed_migrations = 0; // elements the border-only migrations missed (check_migration)
+    algorithm::CellLists<N> cells(params->cell_lists);
     std::vector<Complexity> my_frame_cmplx(nframes);
 
+    // Neighbour lists (and the halo) are only rebuilt when a particle moved more than skin/2
+    std::unique_ptr<algorithm::VerletList<N>> verlet;
+    if(params->verlet_skin > 0) verlet = std::make_unique<algorithm::VerletList<N>>(params->verlet_skin);
+    // Scratch memory of the force kernels (thread buffers, SOA_PARTICLE_STORE copy), reused by every step
+    lj::Workspace<N> step_workspace;
+    GhostExchangePlan ghost_plan;
+    // Bordering cells of the partition, only queried again for new cells or after a load balancing
+    BorderCache<N> border_cache;
+    // Ownership and border queries run on the cuts of the partition, taken again after every load balancing
+    auto partition = partitioning::CutTree::from(LB, nproc);
+    // With check_migration, the local particles and random points of the box must go to the same part with the cuts
+    // as with the load balancer
+    Integer cut_mismatches = 0;
+    auto check_partition = [&]() {
+        if (!params->check_migration) return;
+        std::mt19937 gen(params->seed + rank);
+        std::uniform_real_distribution<Real> in_box(0, params->simsize);
+        std::vector<std::array<Real, N>> points(1000);
+        for (auto& point : points) for (auto& x : point) x = in_box(gen);
+        for (auto& e : mesh_data->els) points.push_back(*getPosPtrFunc(e));
+        cut_mismatches += count_assignment_mismatches(LB, *partition, points.size(), [&points](std::ptrdiff_t k) -> const auto& { return points[k]; });
+    };
+    check_partition();
+    // Object weights given to the load balancer, computed from the cell lists of the step before balancing
+    ObjectWeights<N> lb_weights(params->lb_weighting);
+    // Local particles are reordered along a space-filling curve when the neighbour structures are rebuilt anyway
+    algorithm::CurveSorter<N, T> sorter(params->sfc_order);
+    int steps_since_sort = 0;
+    // Ghosts only carry their position on the wire and in memory
+    using Ghost = elements::Ghost<N>;
+    MPI_Datatype ghost_datatype = elements::register_ghost_datatype<N>();
+    // Communication buffers reused by every halo exchange and every migration of the run
+    CommBuffers<Ghost> halo_buffers;
+    CommBuffers<T> migration_buffers;
+    // Iteration times reduced in one collective per step; with deferred statistics the load balancing time is reduced
+    // with those of the next step and charged to it, otherwise to the step that balanced
+    LoadStatistics load_stats(comm, params->deferred_stats);
+    Time pending_lb_time = 0;
+    // Iteration after which the partition was last balanced (-1: initial partitioning), the state of the trace
+    Integer lb_iteration = -1;
+    auto account_load = [&](const IterationLoad& load) {
+        probe->set_iteration_times(load.max_it, load.min_it, load.sum_it);
+        probe->update_cumulative_imbalance_time();
+        if (load.lb_time > 0) {
+            probe->push_load_balancing_time(load.lb_time);
+            if(!rank) {
+                std::cout << "Average C = " << probe->compute_avg_lb_time() << std::endl;
+            }
+        }
+        return load.max_it + load.lb_time;
+    };
+
     // Compute my bounding box as function of my local data
     auto bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, mesh_data->els);
     // Compute which cells are on my borders
-    auto borders   = get_border_cells_index<N>(LB, bbox, params->rc, boxIntersectFunc, comm);
-    // Get the ghost data from neighboring processors
-    auto remote_el = get_ghost_data<N>(mesh_data->els, getPosPtrFunc, &head, &lscl, bbox, borders, params->rc, datatype, comm);
+    auto borders   = border_cache.get(partition.get(), bbox, params->rc, boxIntersectFunc, comm);
+    // Post the ghost data to the neighboring processors, the step completes the exchange (cells then hold the
+    // cell lists of the step) after the force computation of the interior cells
+    std::vector<Ghost> remote_el;
+    std::optional<SparseExchange<Ghost>> halo;
+    halo.emplace(start_ghost_exchange<N>(mesh_data->els, getPosPtrFunc, &cells, bbox, borders, params->rc, ghost_datatype, comm, &remote_el, &ghost_plan, &halo_buffers));
 
     const int nb_data = mesh_data->els.size();
     for(int i = 0; i < nb_data; ++i) mesh_data->els[i].lid = i;
@@ -104,18 +167,23 @@ std::tuple<ApplicationTime, CumulativeLoadImbalanceHistory, Decisions, TimeHisto
         Time comp_time = 0.0;
         Complexity complexity = 0;
         for (int i = 0; i < npframe; ++i) {
+            const Integer iteration = (Integer) frame * npframe + i;
             START_TIMER(it_compute_time);
-            complexity += lj::compute_one_step<N>(mesh_data->els, remote_el, getPosPtrFunc, getVelPtrFunc, &head, &lscl, bbox,  getForceFunc, borders, params);
+            const auto it_complexity = lj::compute_one_step<N>(mesh_data->els, remote_el, getPosPtrFunc, getVelPtrFunc, &cells, bbox,  getForceFunc, borders, params, verlet.get(), halo ? &*halo : nullptr, &step_workspace);
             END_TIMER(it_compute_time);
+            complexity += it_complexity;
+            const Time local_compute_time = it_compute_time;
+            halo.reset();
+
+            const bool rebuild_neighbors = !verlet || verlet->needs_rebuild(mesh_data->els, getPosPtrFunc, comm);
 
-            // Measure load imbalance
-            MPI_Allreduce(&it_compute_time, probe->max_it_time(), 1, MPI_TIME, MPI_MAX, comm);
-            MPI_Allreduce(&it_compute_time, probe->min_it_time(), 1, MPI_TIME, MPI_MIN, comm);
-            MPI_Allreduce(&it_compute_time, probe->sum_it_time(), 1, MPI_TIME, MPI_SUM, comm);
-            probe->update_cumulative_imbalance_time();
-            it_compute_time = *probe->max_it_time();
+            // Measure load imbalance, with deferred statistics those of the previous step (none at the first one)
+            IterationLoad load;
+            const bool has_load = load_stats.reduce(it_compute_time, pending_lb_time, &load);
+            it_compute_time = has_load ? account_load(load) : 0.0;
+            pending_lb_time = 0;
 
-            if(probe->is_balanced()) {
+            if(has_load && probe->is_balanced()) {
                 probe->update_lb_parallel_efficiencies();
             }
 
@@ -124,29 +192,61 @@ std::tuple<ApplicationTime, CumulativeLoadImbalanceHistory, Decisions, TimeHisto
             cum_li_hist.push_back(probe->get_cumulative_imbalance_time());
             dec.push_back(lb_decision);
 
+            Time local_lb_time = 0;
             if (lb_decision) {
-                PAR_START_TIMER(lb_time_spent, MPI_COMM_WORLD);
+                PAR_START_TIMER(lb_time_spent, comm);
+                lb_weights.compute(mesh_data->els, bbox, params->rc, &cells, &mesh_data->weights);
                 doLoadBalancingFunc(LB, mesh_data);
-                PAR_END_TIMER(lb_time_spent, MPI_COMM_WORLD);
-                MPI_Allreduce(MPI_IN_PLACE, &lb_time_spent,  1, MPI_TIME, MPI_MAX, MPI_COMM_WORLD);
-                probe->push_load_balancing_time(lb_time_spent);
-                probe->reset_cumulative_imbalance_time();
-                it_compute_time += lb_time_spent;
-                if(!rank) {
-                    std::cout << "Average C = " << probe->compute_avg_lb_time() << std::endl;
+                partition = partitioning::CutTree::from(LB, nproc);
+                border_cache.invalidate();
+                PAR_END_TIMER(lb_time_spent, comm);
+                local_lb_time = lb_time_spent;
+                check_partition();
+                if (params->deferred_stats) {
+                    pending_lb_time = lb_time_spent;
+                } else {
+                    MPI_Allreduce(MPI_IN_PLACE, &lb_time_spent, 1, MPI_TIME, MPI_MAX, comm);
+                    probe->push_load_balancing_time(lb_time_spent);
+                    it_compute_time += lb_time_spent;
+                    if(!rank) {
+                        std::cout << "Average C = " << probe->compute_avg_lb_time() << std::endl;
+                    }
                 }
-            } else {
-                migrate_data(LB, mesh_data->els, pointAssignFunc, datatype, comm);
+                probe->reset_cumulative_imbalance_time();
+            } else if (rebuild_neighbors) {
+                // the cell lists are those of the step that just ran unless Verlet lists kept them over several steps,
+                // the elements then moved by up to skin/2 since the last rebuild plus the step that triggered this one
+                const Real max_displacement = verlet ? verlet->get_skin() / 2 + params->rc : 0;
+                get_migration_candidates<N>(bbox, params->rc, &cells, mesh_data->els.size(), &migration_candidates, max_displacement);
+                missed_migrations += migrate_border_data(partition.get(), mesh_data->els, pointAssignFunc, datatype, comm, migration_candidates, &migration_buffers, params->check_migration);
             }
 
+            if (recorder) {
+                const Integer migrated = !lb_decision && rebuild_neighbors ? migration_buffers.nb_elements_sent() : 0;
+                recorder->iteration(iteration, lb_iteration, local_compute_time, it_complexity, migrated);
+                if (lb_decision) recorder->load_balancing(iteration, lb_iteration, local_lb_time);
+            }
+            if (lb_decision) lb_iteration = iteration;
+
             probe->set_balanced(lb_decision);
 
             total_time += it_compute_time;
             time_hist.push_back(total_time);
 
-            bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, mesh_data->els);
-            borders   = get_border_cells_index<N>(LB, bbox, params->rc, boxIntersectFunc, comm);
-            remote_el = get_ghost_data<N>(mesh_data->els, getPosPtrFunc, &head, &lscl, bbox, borders, params->rc, datatype, comm);
+            steps_since_sort++;
+            if (lb_decision || rebuild_neighbors) {
+                bbox      = get_bounding_box<N>(params->rc, getPosPtrFunc, mesh_data->els);
+                if (sorter.enabled() && steps_since_sort >= params->sfc_every) {
+                    sorter.sort(mesh_data->els, getPosPtrFunc, bbox, params->rc, params->nb_threads);
+                    steps_since_sort = 0;
+                }
+                borders   = border_cache.get(partition.get(), bbox, params->rc, boxIntersectFunc, comm);
+                halo.emplace(start_ghost_exchange<N>(mesh_data->els, getPosPtrFunc, &cells, bbox, borders, params->rc, ghost_datatype, comm, &remote_el, &ghost_plan, &halo_buffers));
+                if (verlet) verlet->invalidate();
+            } else {
+                // particles stay where they are between two rebuilds, only the halo positions are refreshed
+                refresh_ghost_data(mesh_data->els, remote_el, ghost_plan, ghost_datatype, comm, &halo_buffers);
+            }
 
             comp_time += it_compute_time;
             probe->next_iteration();
@@ -181,6 +281,50 @@ std::tuple<ApplicationTime, CumulativeLoadImbalanceHistory, Decisions, TimeHisto
         my_frame_cmplx[frame] = complexity;
     }
 
+    // with deferred statistics, those still in flight and the load balancing time of the last step go to the last step
+    {
+        Time tail_time = 0;
+        IterationLoad load;
+        if (load_stats.flush(&load)) tail_time += account_load(load);
+        if (pending_lb_time > 0) {
+            load_stats.reduce(0.0, pending_lb_time, &load);
+            load_stats.flush(&load);
+            probe->push_load_balancing_time(load.lb_time);
+            tail_time += load.lb_time;
+        }
+        if (tail_time > 0 && !time_hist.empty()) {
+            total_time += tail_time;
+            time_hist.back() = total_time;
+            probe->batch_time += tail_time;
+            my_frame_times[nframes - 1] = probe->batch_time;
+            app_time += tail_time;
+        }
+    }
+
+    // the halo of the step after the last one
+    if (halo) halo->wait();
+    MPI_Type_free(&ghost_datatype);
+
+    // peak memory of the communication buffers, over the PEs
+    {
+        const auto& halo_peak = halo_buffers.high_water_marks();
+        const auto& migration_peak = migration_buffers.high_water_marks();
+        unsigned long long peaks[4] = {halo_peak.bytes, halo_peak.partners, migration_peak.bytes, migration_peak.partners};
+        MPI_Reduce(rank ? peaks : MPI_IN_PLACE, peaks, 4, MPI_UNSIGNED_LONG_LONG, MPI_MAX, 0, comm);
+        if(!rank) {
+            std::cout << "Communication buffers high-water marks (max over PEs): halo " << peaks[0] << " bytes, "
+                      << peaks[1] << " neighbors; migration " << peaks[2] << " bytes, " << peaks[3] << " neighbors" << std::endl;
+        }
+    }
+
+    if(params->check_migration) {
+        MPI_Allreduce(MPI_IN_PLACE, &cut_mismatches, 1, MPI_LONG_LONG, MPI_SUM, comm);
+        if(!rank) {
+            std::cout << "Border-only migration: " << missed_migrations << " elements missed (full migration instead)" << std::endl;
+            std::cout << "Cuts of the partition: " << cut_mismatches << " points assigned to another part than by the load balancer" << std::endl;
+        }
+    }
+
     MPI_Barrier(comm);
     std::vector<Time> max_times(nframes), min_times(nframes), avg_times(nframes);
     Time sum_times;
@@ -198,13 +342,13 @@ std::tuple<ApplicationTime, CumulativeLoadImbalanceHistory, Decisions, TimeHisto
     }
 
     for (int frame = 0; frame < nframes; ++frame) {
-        MPI_Reduce(&my_frame_times[frame], &max_times[frame], 1, MPI_TIME, MPI_MAX, 0, MPI_COMM_WORLD);
-        MPI_Reduce(&my_frame_times[frame], &min_times[frame], 1, MPI_TIME, MPI_MIN, 0, MPI_COMM_WORLD);
-        MPI_Reduce(&my_frame_times[frame], &sum_times,        1, MPI_TIME, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&my_frame_times[frame], &max_times[frame], 1, MPI_TIME, MPI_MAX, 0, comm);
+        MPI_Reduce(&my_frame_times[frame], &min_times[frame], 1, MPI_TIME, MPI_MIN, 0, comm);
+        MPI_Reduce(&my_frame_times[frame], &sum_times,        1, MPI_TIME, MPI_SUM, 0, comm);
 
-        MPI_Reduce(&my_frame_cmplx[frame], &max_cmplx[frame], 1, MPI_COMPLEXITY, MPI_MAX, 0, MPI_COMM_WORLD);
-        MPI_Reduce(&my_frame_cmplx[frame], &min_cmplx[frame], 1, MPI_COMPLEXITY, MPI_MIN, 0, MPI_COMM_WORLD);
-        MPI_Reduce(&my_frame_cmplx[frame], &sum_cmplx,        1, MPI_COMPLEXITY, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&my_frame_cmplx[frame], &max_cmplx[frame], 1, MPI_COMPLEXITY, MPI_MAX, 0, comm);
+        MPI_Reduce(&my_frame_cmplx[frame], &min_cmplx[frame], 1, MPI_COMPLEXITY, MPI_MIN, 0, comm);
+        MPI_Reduce(&my_frame_cmplx[frame], &sum_cmplx,        1, MPI_COMPLEXITY, MPI_SUM, 0, comm);
 
         if(!rank) {
             avg_times[frame] = sum_times / nproc;
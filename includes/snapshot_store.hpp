@@ -0,0 +1,295 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_SNAPSHOT_STORE_HPP
+#define NBMPI_SNAPSHOT_STORE_HPP
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace snapshot {
+
+    using Byte = std::uint8_t;
+    using Bits = std::conditional_t<sizeof(Real) == 4, std::uint32_t, std::uint64_t>;
+
+    inline void put_varint(std::vector<Byte>& out, std::uint64_t v) {
+        while (v >= 0x80) { out.push_back((Byte) (v | 0x80)); v >>= 7; }
+        out.push_back((Byte) v);
+    }
+    inline std::uint64_t get_varint(const Byte*& in) {
+        std::uint64_t v = 0;
+        for (int shift = 0; ; shift += 7) {
+            const Byte b = *in++;
+            v |= (std::uint64_t) (b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+    }
+    inline void put_zigzag(std::vector<Byte>& out, std::int64_t v) { put_varint(out, ((std::uint64_t) v << 1) ^ (std::uint64_t) (v >> 63)); }
+    inline std::int64_t get_zigzag(const Byte*& in) { const auto v = get_varint(in); return (std::int64_t) (v >> 1) ^ -(std::int64_t) (v & 1); }
+
+    inline Bits to_bits(Real r) { Bits b; std::memcpy(&b, &r, sizeof(Real)); return b; }
+    inline Real from_bits(Bits b) { Real r; std::memcpy(&r, &b, sizeof(Real)); return r; }
+
+    /**
+     * A frame of particles encoded against a reference frame (the previous one): the bits of every position and
+     * velocity component are XORed with those of the same particle (gid) in the reference, so a particle that
+     * barely moved leaves only its low order bytes, and only the significant bytes are kept. Without reference
+     * (key frame) or for a particle absent from it, the value is XORed with that of the previous particle.
+     * Layout: n, (zigzag(gid - previous gid), zigzag(lid - index)) * n, 4-bit byte counts, significant bytes.
+     */
+    template<class T>
+    struct Block {
+        static constexpr int N = std::tuple_size<decltype(T::position)>::value;
+        static constexpr int nb_values = 2 * N;
+
+        std::vector<Byte> bytes;                  // empty once spilled
+        std::shared_ptr<const Block> reference;   // null: key frame
+        int depth = 0;                            // number of blocks to decode before this one
+        Integer size = 0;
+        std::streamoff offset = -1;               // position in the spill file
+        std::size_t nb_bytes = 0;
+
+        bool spilled() const { return offset >= 0; }
+
+        static std::array<Real, nb_values> values_of(const T& e) {
+            std::array<Real, nb_values> v;
+            std::copy(e.position.cbegin(), e.position.cend(), v.begin());
+            std::copy(e.velocity.cbegin(), e.velocity.cend(), v.begin() + N);
+            return v;
+        }
+
+        /* index of the particles of the reference, the common case (same order) is found without it */
+        class ReferenceIndex {
+            const std::vector<T>* ref;
+            std::vector<std::pair<Index, Integer>> by_gid;
+        public:
+            explicit ReferenceIndex(const std::vector<T>* ref) : ref(ref) {}
+            const T* find(Index gid, Integer hint) {
+                if (!ref) return nullptr;
+                if (hint < (Integer) ref->size() && (*ref)[hint].gid == gid) return &(*ref)[hint];
+                if (by_gid.empty()) {
+                    by_gid.reserve(ref->size());
+                    for (Integer j = 0; j < (Integer) ref->size(); ++j) by_gid.emplace_back((*ref)[j].gid, j);
+                    std::sort(by_gid.begin(), by_gid.end());
+                }
+                auto it = std::lower_bound(by_gid.cbegin(), by_gid.cend(), std::make_pair(gid, (Integer) 0));
+                return it != by_gid.cend() && it->first == gid ? &(*ref)[it->second] : nullptr;
+            }
+        };
+
+        static void encode(const std::vector<T>& els, const std::vector<T>* ref, std::vector<Byte>* out) {
+            const Integer n = els.size();
+            std::vector<Byte> counts((n * nb_values + 1) / 2, 0), payload;
+            payload.reserve(n * nb_values * sizeof(Real));
+            out->clear();
+            put_varint(*out, n);
+            Index previous_gid = 0;
+            for (Integer i = 0; i < n; ++i) {
+                put_zigzag(*out, (std::int64_t) els[i].gid - (std::int64_t) previous_gid);
+                put_zigzag(*out, (std::int64_t) els[i].lid - i);
+                previous_gid = els[i].gid;
+            }
+            ReferenceIndex index(ref);
+            std::array<Real, nb_values> previous {};
+            for (Integer i = 0; i < n; ++i) {
+                const auto r = index.find(els[i].gid, i);
+                const auto base = r ? values_of(*r) : previous;
+                const auto values = values_of(els[i]);
+                for (int k = 0; k < nb_values; ++k) {
+                    Bits x = to_bits(values[k]) ^ to_bits(base[k]);
+                    Byte nb = 0;
+                    for (; x; x >>= 8, ++nb) payload.push_back((Byte) x);
+                    const Integer slot = i * nb_values + k;
+                    counts[slot / 2] |= nb << (4 * (slot % 2));
+                }
+                previous = values;
+            }
+            out->insert(out->end(), counts.cbegin(), counts.cend());
+            out->insert(out->end(), payload.cbegin(), payload.cend());
+        }
+
+        static void decode(const Byte* in, const std::vector<T>* ref, std::vector<T>* els) {
+            const Integer n = get_varint(in);
+            els->resize(n);
+            Index gid = 0;
+            for (Integer i = 0; i < n; ++i) {
+                gid += (Index) get_zigzag(in);
+                (*els)[i].gid = gid;
+                (*els)[i].lid = (Index) (get_zigzag(in) + i);
+            }
+            const Byte* counts = in;
+            const Byte* payload = in + (n * nb_values + 1) / 2;
+            ReferenceIndex index(ref);
+            std::array<Real, nb_values> previous {};
+            for (Integer i = 0; i < n; ++i) {
+                auto& e = (*els)[i];
+                const auto r = index.find(e.gid, i);
+                const auto base = r ? values_of(*r) : previous;
+                for (int k = 0; k < nb_values; ++k) {
+                    const Integer slot = i * nb_values + k;
+                    const Byte nb = (counts[slot / 2] >> (4 * (slot % 2))) & 0xf;
+                    Bits x = 0;
+                    for (Byte b = 0; b < nb; ++b) x |= (Bits) *payload++ << (8 * b);
+                    const Real v = from_bits(x ^ to_bits(base[k]));
+                    if (k < N) e.position[k] = v; else e.velocity[k - N] = v;
+                }
+                previous = values_of(e);
+            }
+        }
+    };
+
+    /**
+     * State of the local particles at the frames of the A* search. With no memory budget the frames are kept
+     * as they are (stored by move, restored into the caller's buffer). With a budget (bytes) they are encoded
+     * against the previous frame, with a key frame every max_depth frames, and the blocks above the budget are
+     * written to a spill file. A block stays alive as long as a newer frame refers to it.
+     */
+    template<class T>
+    class SnapshotStore {
+        using BlockPtr = std::shared_ptr<const Block<T>>;
+        static constexpr int max_depth = 8;
+
+        long long budget;
+        std::string spill_filename;
+        std::fstream spill;
+        std::vector<std::vector<T>> raw;
+        std::vector<BlockPtr> frames;
+        std::list<std::weak_ptr<Block<T>>> resident;   // blocks in memory, oldest first
+        BlockPtr cached_block;                         // last block decoded or stored ...
+        std::vector<T> cache;                          // ... and its particles
+        std::vector<Byte> buffer;
+        std::size_t raw_bytes = 0, encoded_bytes = 0, nb_spilled = 0;
+
+        bool compressed() const { return budget > 0; }
+
+        const Byte* bytes_of(const Block<T>& b) {
+            if (!b.spilled()) return b.bytes.data();
+            buffer.resize(b.nb_bytes);
+            spill.seekg(b.offset);
+            spill.read((char*) buffer.data(), b.nb_bytes);
+            return buffer.data();
+        }
+
+        void decode(const BlockPtr& b, std::vector<T>* els) {
+            std::vector<T> reference;
+            const std::vector<T>* ref = nullptr;
+            if (b->reference) {
+                if (b->reference == cached_block) ref = &cache;
+                else { decode(b->reference, &reference); ref = &reference; }
+            }
+            Block<T>::decode(bytes_of(*b), ref, els);
+        }
+
+        /* write the oldest blocks to the spill file until the blocks in memory fit in the budget */
+        void enforce_budget() {
+            long long in_memory = 0;
+            for (auto it = resident.begin(); it != resident.end();) {
+                if (auto b = it->lock()) { in_memory += b->nb_bytes; ++it; }
+                else it = resident.erase(it);
+            }
+            while (in_memory > budget && resident.size() > 1) {
+                auto b = resident.front().lock();
+                resident.pop_front();
+                if (!b) continue;
+                if (!spill.is_open()) {
+                    spill.open(spill_filename, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+                    if (!spill.is_open()) throw std::runtime_error("cannot open the snapshot spill file " + spill_filename);
+                }
+                spill.seekp(0, std::ios::end);
+                b->offset = spill.tellp();
+                spill.write((const char*) b->bytes.data(), b->nb_bytes);
+                std::vector<Byte>().swap(b->bytes);
+                in_memory -= b->nb_bytes;
+                nb_spilled++;
+            }
+        }
+    public:
+        SnapshotStore(std::size_t nb_frames, long long budget, std::string spill_filename) :
+            budget(budget), spill_filename(std::move(spill_filename)), raw(compressed() ? 0 : nb_frames), frames(nb_frames) {}
+
+        ~SnapshotStore() {
+            if (spill.is_open()) {
+                spill.close();
+                std::remove(spill_filename.c_str());
+            }
+        }
+
+        SnapshotStore(const SnapshotStore&) = delete;
+        SnapshotStore& operator=(const SnapshotStore&) = delete;
+
+        void store(std::size_t frame, std::vector<T>&& els) {
+            raw_bytes += els.size() * sizeof(T);
+            if (!compressed()) { raw.at(frame) = std::move(els); return; }
+
+            auto b = std::make_shared<Block<T>>();
+            b->size = els.size();
+            const std::vector<T>* ref = nullptr;
+            std::vector<T> reference;
+            if (frame > 0 && frames.at(frame - 1) && frames[frame - 1]->depth + 1 < max_depth) {
+                b->reference = frames[frame - 1];
+                b->depth = b->reference->depth + 1;
+                if (b->reference == cached_block) ref = &cache;
+                else { decode(b->reference, &reference); ref = &reference; }
+            }
+            Block<T>::encode(els, ref, &b->bytes);
+            b->bytes.shrink_to_fit();
+            b->nb_bytes = b->bytes.size();
+            encoded_bytes += b->nb_bytes;
+            frames.at(frame) = b;
+            resident.push_back(b);
+            cached_block = b;
+            cache = std::move(els);
+            enforce_budget();
+        }
+
+        /* copy of the particles of a frame into els, whose storage is reused */
+        void restore(std::size_t frame, std::vector<T>* els) {
+            if (!compressed()) { els->assign(raw.at(frame).cbegin(), raw.at(frame).cend()); return; }
+            const auto& b = frames.at(frame);
+            if (!b) { els->clear(); return; }
+            if (b == cached_block) { els->assign(cache.cbegin(), cache.cend()); return; }
+            decode(b, els);
+            cached_block = b;
+            cache.assign(els->cbegin(), els->cend());
+        }
+
+        /* read-only particles of a frame, valid until the next call to the store */
+        const std::vector<T>& view(std::size_t frame) {
+            if (!compressed()) return raw.at(frame);
+            const auto& b = frames.at(frame);
+            if (!b) {
+                cached_block = nullptr;
+                cache.clear();
+            } else if (b != cached_block) {
+                std::vector<T> els;
+                decode(b, &els);
+                cached_block = b;
+                cache.swap(els);
+            }
+            return cache;
+        }
+
+        void reserve(std::size_t nb_elements) {
+            for (auto& els : raw) els.reserve(nb_elements);
+            cache.reserve(nb_elements);
+        }
+
+        std::size_t get_raw_bytes() const { return raw_bytes; }
+        std::size_t get_encoded_bytes() const { return compressed() ? encoded_bytes : raw_bytes; }
+        std::size_t get_nb_spilled() const { return nb_spilled; }
+    };
+}
+#endif //NBMPI_SNAPSHOT_STORE_HPP
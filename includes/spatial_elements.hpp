@@ -148,6 +148,22 @@ namespace elements {
 
     };
 
+    /**
+     * Halo wire format: a ghost only carries what the force kernels read, its position (N reals instead of the
+     * 2 ids + 2N reals of an Element). Received ghosts are never integrated nor migrated.
+     */
+    template<int N>
+    struct Ghost {
+        std::array<Real, N> position;
+
+        constexpr Ghost() : position() {}
+        explicit constexpr Ghost(const Element<N>& e) : position(e.position) {}
+
+        static constexpr auto byte_size() {
+            return N * sizeof(Real);
+        }
+    };
+
     template<int N>
     void import_from_file_float(std::string filename, std::vector<Element<N>>& particles) {
 
@@ -310,6 +326,15 @@ namespace elements {
 
         return element_datatype;
     }
+
+    template<int N, bool UseDoublePrecision = std::is_same<Real, double>::value>
+    MPI_Datatype register_ghost_datatype() {
+        static_assert(sizeof(Ghost<N>) == Ghost<N>::byte_size(), "Ghost<N> must be N packed reals");
+        MPI_Datatype ghost_datatype;
+        MPI_Type_contiguous(N, UseDoublePrecision ? MPI_DOUBLE : MPI_FLOAT, &ghost_datatype);
+        MPI_Type_commit(&ghost_datatype);
+        return ghost_datatype;
+    }
 }
 
 #endif //NBMPI_GEOMETRIC_ELEMENT_HPP
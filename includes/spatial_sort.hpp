@@ -0,0 +1,154 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_SPATIAL_SORT_HPP
+#define NBMPI_SPATIAL_SORT_HPP
+
+#include "utils.hpp"
+#include "thread_pool.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+enum CurveOrder {NoCurveOrder=0, MortonOrder=1, HilbertOrder=2};
+
+namespace algorithm {
+
+    /* interleave the b low bits of the N coordinates, most significant bit of x[0] first */
+    template<int N>
+    inline uint64_t interleave_bits(const std::array<uint32_t, N>& x, int b) {
+        uint64_t key = 0;
+        for (int bit = b - 1; bit >= 0; --bit)
+            for (int dim = 0; dim < N; ++dim) key = (key << 1) | ((x[dim] >> bit) & 1u);
+        return key;
+    }
+
+    /* position along the Z curve of a cell of a 2^b grid */
+    template<int N>
+    inline uint64_t morton_key(const std::array<uint32_t, N>& cell, int b) {
+        return interleave_bits<N>(cell, b);
+    }
+
+    /* position along the Hilbert curve of a cell of a 2^b grid (J. Skilling, Programming the Hilbert curve, 2004) */
+    template<int N>
+    inline uint64_t hilbert_key(std::array<uint32_t, N> x, int b) {
+        const uint32_t M = 1u << (b - 1);
+        for (uint32_t Q = M; Q > 1; Q >>= 1) {
+            const uint32_t P = Q - 1;
+            for (int i = 0; i < N; ++i) {
+                if (x[i] & Q) x[0] ^= P;
+                else {
+                    const uint32_t t = (x[0] ^ x[i]) & P;
+                    x[0] ^= t;
+                    x[i] ^= t;
+                }
+            }
+        }
+        for (int i = 1; i < N; ++i) x[i] ^= x[i - 1];
+        uint32_t t = 0;
+        for (uint32_t Q = M; Q > 1; Q >>= 1) if (x[N - 1] & Q) t ^= Q - 1;
+        for (int i = 0; i < N; ++i) x[i] ^= t;
+        return interleave_bits<N>(x, b);
+    }
+
+    /**
+     * Reorders the local elements along a space-filling curve over the cells of the bounding box, such that the
+     * elements of a cell are contiguous and the cells close in space are close in memory: the traversal of the cell
+     * lists then walks through memory almost sequentially.
+     * The elements are moved with their gid, their lid is set to their new index. Any structure indexing the elements
+     * (cell lists, Verlet lists, ghost plans, migration candidates) must be rebuilt after a sort.
+     * The keys are sorted with a stable LSD radix sort (8 bits per pass) whose histogram and scatter phases run on the
+     * thread pool; the buffers, elements included, are kept from one sort to the next.
+     */
+    template<int N, class T>
+    class CurveSorter {
+        static constexpr int RADIX_BITS = 8, RADIX = 1 << RADIX_BITS;
+        CurveOrder order;
+        std::vector<uint64_t> keys, keys_tmp;
+        std::vector<Index> perm, perm_tmp;
+        std::vector<Integer> histograms;
+        std::vector<T> sorted;
+
+        /* f(tid, begin, end) over one contiguous block of [0, n) per thread, blocks in tid order */
+        template<class F>
+        static void for_each_block(int nb_threads, Integer n, F f) {
+            if (nb_threads <= 1) { f(0, 0, n); return; }
+            auto& pool = parallel::get_thread_pool(nb_threads);
+            const int nb_blocks = pool.size();
+            pool.run([&](int tid) { f(tid, n * tid / nb_blocks, n * (tid + 1) / nb_blocks); });
+        }
+
+        void radix_sort(int key_bits, int nb_threads) {
+            const Integer n = keys.size();
+            const int nb_blocks = nb_threads <= 1 ? 1 : parallel::get_thread_pool(nb_threads).size();
+            keys_tmp.resize(n);
+            perm_tmp.resize(n);
+            for (int shift = 0; shift < key_bits; shift += RADIX_BITS) {
+                histograms.assign(nb_blocks * RADIX, 0);
+                for_each_block(nb_threads, n, [&](int tid, Integer begin, Integer end) {
+                    Integer* h = &histograms[tid * RADIX];
+                    for (Integer i = begin; i < end; ++i) h[(keys[i] >> shift) & (RADIX - 1)]++;
+                });
+                // exclusive prefix sum in (digit, thread) order keeps the sort stable
+                Integer offset = 0;
+                for (int d = 0; d < RADIX; ++d)
+                    for (int tid = 0; tid < nb_blocks; ++tid) {
+                        const Integer count = histograms[tid * RADIX + d];
+                        histograms[tid * RADIX + d] = offset;
+                        offset += count;
+                    }
+                for_each_block(nb_threads, n, [&](int tid, Integer begin, Integer end) {
+                    Integer* h = &histograms[tid * RADIX];
+                    for (Integer i = begin; i < end; ++i) {
+                        const Integer dst = h[(keys[i] >> shift) & (RADIX - 1)]++;
+                        keys_tmp[dst] = keys[i];
+                        perm_tmp[dst] = perm[i];
+                    }
+                });
+                keys.swap(keys_tmp);
+                perm.swap(perm_tmp);
+            }
+        }
+
+    public:
+        explicit CurveSorter(int order) : order(static_cast<CurveOrder>(order)) {}
+
+        bool enabled() const { return order != NoCurveOrder; }
+
+        template<class GetPosFunc>
+        void sort(std::vector<T>& elements, GetPosFunc getPosFunc, const BoundingBox<N>& bbox, Real rc,
+                  int nb_threads = 1) {
+            if (!enabled() || elements.size() < 2) return;
+            const Integer n = elements.size();
+            const auto lc = get_cell_number_by_dimension<N>(bbox, rc);
+            int b = 1;
+            for (int dim = 0; dim < N; ++dim) while ((Integer(1) << b) < lc[dim]) b++;
+
+            keys.resize(n);
+            perm.resize(n);
+            parallel::for_range(nb_threads, n, [&](Integer begin, Integer end) {
+                for (Integer i = begin; i < end; ++i) {
+                    const auto& pos = *getPosFunc(elements[i]);
+                    std::array<uint32_t, N> cell;
+                    for (int dim = 0; dim < N; ++dim)
+                        cell[dim] = (uint32_t) std::max((Integer) 0, (Integer) std::floor((pos[dim] - bbox[2*dim]) / rc));
+                    keys[i] = order == HilbertOrder ? hilbert_key<N>(cell, b) : morton_key<N>(cell, b);
+                    perm[i] = i;
+                }
+            });
+            radix_sort(N * b, nb_threads);
+
+            sorted.resize(n);
+            parallel::for_range(nb_threads, n, [&](Integer begin, Integer end) {
+                for (Integer i = begin; i < end; ++i) {
+                    sorted[i] = elements[perm[i]];
+                    sorted[i].lid = i;
+                }
+            });
+            elements.swap(sorted);
+        }
+    };
+}
+#endif //NBMPI_SPATIAL_SORT_HPP
@@ -0,0 +1,119 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_THREAD_POOL_HPP
+#define NBMPI_THREAD_POOL_HPP
+
+#include "utils.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+    /**
+     * Persistent pool of threads living inside one MPI process. The calling thread takes part in the work as
+     * thread 0, so a pool of size T spawns T-1 workers. Only the calling thread is expected to call MPI.
+     */
+    class ThreadPool {
+        std::vector<std::thread> workers;
+        std::mutex m;
+        std::condition_variable cv_start, cv_done;
+        std::function<void (int)> job;
+        unsigned long generation = 0;
+        int pending = 0;
+        bool stop = false;
+
+        void work(int tid) {
+            unsigned long seen = 0;
+            for (;;) {
+                std::function<void (int)> current;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    cv_start.wait(lock, [&] { return stop || generation != seen; });
+                    if (stop) return;
+                    seen = generation;
+                    current = job;
+                }
+                current(tid);
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    if (--pending == 0) cv_done.notify_one();
+                }
+            }
+        }
+
+    public:
+        explicit ThreadPool(int nb_threads) {
+            for (int tid = 1; tid < nb_threads; ++tid) workers.emplace_back(&ThreadPool::work, this, tid);
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stop = true;
+            }
+            cv_start.notify_all();
+            for (auto& w : workers) w.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        int size() const { return workers.size() + 1; }
+
+        /* Execute f(tid) on every thread of the pool and wait for all of them */
+        void run(std::function<void (int)> f) {
+            if (workers.empty()) { f(0); return; }
+            {
+                std::lock_guard<std::mutex> lock(m);
+                job = f;
+                pending = workers.size();
+                generation++;
+            }
+            cv_start.notify_all();
+            f(0);
+            std::unique_lock<std::mutex> lock(m);
+            cv_done.wait(lock, [&] { return pending == 0; });
+        }
+
+        /* Dynamic scheduling of [begin, end) by chunks of grain items, f(tid, chunk_begin, chunk_end) */
+        template<class F>
+        void parallel_for(Integer begin, Integer end, Integer grain, F f) {
+            if (end <= begin) return;
+            grain = std::max((Integer) 1, grain);
+            std::atomic<Integer> next(begin);
+            run([&](int tid) {
+                for (Integer b = next.fetch_add(grain); b < end; b = next.fetch_add(grain))
+                    f(tid, b, std::min(b + grain, end));
+            });
+        }
+
+        /* Grain giving roughly chunks_per_thread chunks to each thread */
+        Integer grain_for(Integer n_items, Integer chunks_per_thread = 8) const {
+            return std::max((Integer) 1, n_items / (chunks_per_thread * size()));
+        }
+    };
+
+    /* The pool of the process, created on first use and resized if another thread count is requested */
+    inline ThreadPool& get_thread_pool(int nb_threads) {
+        static std::unique_ptr<ThreadPool> pool;
+        if (!pool || pool->size() != nb_threads) pool = std::make_unique<ThreadPool>(std::max(1, nb_threads));
+        return *pool;
+    }
+
+    /* f(begin, end) over [0, n_items), on the pool when more than one thread is requested */
+    template<class F>
+    void for_range(int nb_threads, Integer n_items, F f) {
+        if (nb_threads <= 1) { f(0, n_items); return; }
+        auto& pool = get_thread_pool(nb_threads);
+        pool.parallel_for(0, n_items, pool.grain_for(n_items), [&](int, Integer begin, Integer end) { f(begin, end); });
+    }
+}
+#endif //NBMPI_THREAD_POOL_HPP
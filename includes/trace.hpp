@@ -0,0 +1,229 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_TRACE_HPP
+#define NBMPI_TRACE_HPP
+
+#include "utils.hpp"
+#include "decision_makers/strategy.hpp"
+
+#include <mpi.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+    /**
+     * The state of the partition during an iteration is the iteration after which the last load balancing was done
+     * (-1: the initial partitioning). A trace holds, for every run (astar or the label of a policy) and every
+     * (iteration, state) that run has executed:
+     *   I <run> <iteration> <state> <time of each PE> <complexity of each PE> <elements migrated by each PE>
+     * and for every load balancing done after an iteration, from the state it was done in:
+     *   L <run> <iteration> <state> <load balancing time of each PE>
+     * and the priors the policies were started with (from the A* search, zero without it):
+     *   P <load balancing time> <load balancing parallel efficiency>
+     * The first line is "# nbmpi-trace <PEs> <npframe> <nframes> <LB weights>". With smoothed weights (-W 2) the
+     * partition also depends on the load balancing calls before the state, the state identifies it within one
+     * policy run only and the A* search is not recorded.
+     */
+    using State = std::pair<Integer, Integer>;
+
+    inline Integer normalize(Integer lb_iteration) { return std::max((Integer) -1, lb_iteration); }
+
+    /* Collective: gathers the per-PE values of the iterations on PE 0 and appends them to the trace file */
+    class TraceRecorder {
+        MPI_Comm comm;
+        int rank = 0, nproc = 1;
+        bool enabled;
+        std::ofstream out;
+        std::string run = "run";
+        std::vector<double> gathered;
+
+        void write(char kind, Integer iteration, Integer lb_iteration, const double* local, int n) {
+            gathered.resize(n * nproc);
+            MPI_Gather(local, n, MPI_DOUBLE, gathered.data(), n, MPI_DOUBLE, 0, comm);
+            if (rank) return;
+            out << kind << ' ' << run << ' ' << iteration << ' ' << normalize(lb_iteration);
+            for (int k = 0; k < n; ++k)
+                for (int PE = 0; PE < nproc; ++PE) out << ' ' << gathered[PE * n + k];
+            out << '\n';
+        }
+    public:
+        TraceRecorder(const std::string& filename, const sim_param_t& params, MPI_Comm comm) :
+            comm(comm), enabled(!filename.empty()) {
+            if (!enabled) return;
+            MPI_Comm_rank(comm, &rank);
+            MPI_Comm_size(comm, &nproc);
+            if (!rank) {
+                out.open(filename);
+                out << std::setprecision(9);
+                out << "# nbmpi-trace " << nproc << ' ' << params.npframe << ' ' << params.nframes << ' '
+                    << params.lb_weighting << '\n';
+            }
+        }
+
+        bool is_enabled() const { return enabled; }
+
+        /* the records that follow belong to this run, a label without blanks */
+        void begin_run(const std::string& label) { run = label; }
+
+        void iteration(Integer iteration, Integer lb_iteration, Time time, Complexity complexity, Integer migrated) {
+            if (!enabled) return;
+            const double local[3] = {time, (double) complexity, (double) migrated};
+            write('I', iteration, lb_iteration, local, 3);
+        }
+
+        void load_balancing(Integer iteration, Integer lb_iteration, Time time) {
+            if (!enabled) return;
+            write('L', iteration, lb_iteration, &time, 1);
+        }
+
+        /* the priors are the same on every PE, PE 0 writes them */
+        void priors(const decision_making::PolicyRegistry::Priors& priors) {
+            if (!enabled || rank) return;
+            out << "P " << priors.lb_time << ' ' << priors.lb_parallel_efficiency << '\n';
+        }
+    };
+
+    struct IterationRecord {
+        std::vector<Time> times;
+        std::vector<Complexity> complexities;
+        std::vector<Integer> migrated;
+    };
+
+    /**
+     * A trace loaded in memory, the records of one run or, without run, of every run: the first record of a
+     * (iteration, state) is kept, the runs in the order they were recorded.
+     */
+    class Trace {
+        int nproc = 0, npframe = 0, nframes = 0, lb_weighting = 0;
+        std::vector<std::string> runs;
+        std::map<State, IterationRecord> iterations;
+        std::map<State, std::vector<Time>> lb_times;
+        decision_making::PolicyRegistry::Priors priors;
+    public:
+        explicit Trace(const std::string& filename, const std::string& run = "") {
+            std::ifstream in(filename);
+            if (!in.good()) throw std::runtime_error("cannot open trace " + filename);
+            std::string line, tag, label;
+            std::getline(in, line);
+            std::stringstream header(line);
+            header >> tag >> tag >> nproc >> npframe >> nframes >> lb_weighting;
+            if (tag != "nbmpi-trace" || !nproc) throw std::runtime_error("bad trace header in " + filename);
+            while (std::getline(in, line)) {
+                std::stringstream ss(line);
+                char kind;
+                State s;
+                ss >> kind;
+                if (kind == 'P') {
+                    ss >> priors.lb_time >> priors.lb_parallel_efficiency;
+                    continue;
+                }
+                ss >> label >> s.first >> s.second;
+                if (std::find(runs.cbegin(), runs.cend(), label) == runs.cend()) runs.push_back(label);
+                if (!run.empty() && label != run) continue;
+                if (kind == 'I') {
+                    IterationRecord r;
+                    r.times.resize(nproc); r.complexities.resize(nproc); r.migrated.resize(nproc);
+                    for (auto& t : r.times) ss >> t;
+                    for (auto& c : r.complexities) { double v; ss >> v; c = (Complexity) v; }
+                    for (auto& m : r.migrated) { double v; ss >> v; m = (Integer) v; }
+                    iterations.emplace(s, std::move(r));
+                } else if (kind == 'L') {
+                    std::vector<Time> t(nproc);
+                    for (auto& v : t) ss >> v;
+                    lb_times.emplace(s, std::move(t));
+                }
+            }
+            if (!run.empty() && iterations.empty()) throw std::runtime_error("no run " + run + " in " + filename);
+            if (run.empty() && lb_weighting == 2 && runs.size() > 1)
+                throw std::runtime_error("the states of the runs of " + filename + " are not comparable with smoothed LB weights, replay one run (--run)");
+        }
+
+        int get_nproc()   const { return nproc; }
+        int get_npframe() const { return npframe; }
+        int get_nframes() const { return nframes; }
+        size_t size()     const { return iterations.size(); }
+        const std::vector<std::string>& get_runs() const { return runs; }
+        const decision_making::PolicyRegistry::Priors& get_priors() const { return priors; }
+
+        const IterationRecord* find_iteration(Integer iteration, Integer lb_iteration) const {
+            auto it = iterations.find({iteration, normalize(lb_iteration)});
+            return it == iterations.cend() ? nullptr : &it->second;
+        }
+        const std::vector<Time>* find_load_balancing(Integer iteration, Integer lb_iteration) const {
+            auto it = lb_times.find({iteration, normalize(lb_iteration)});
+            return it == lb_times.cend() ? nullptr : &it->second;
+        }
+    };
+
+    struct ReplayResult {
+        Time total_time = 0;
+        std::vector<Time> cum_li_hist, time_hist;
+        std::vector<int> decisions;
+        Integer nb_iterations = 0;     // iterations replayed, less than the trace length when a state is missing
+        Integer nb_unavailable = 0;    // load balancing decisions whose cost is not in the trace, not applied
+    };
+
+    /**
+     * Drives a policy and its probe with the statistics of a trace instead of running the simulation, the
+     * accounting is that of simulate with blocking statistics: the load balancing time is charged to the iteration
+     * that balanced.
+     */
+    template<class D>
+    ReplayResult replay(const Trace& trace, decision_making::LBPolicy<D>& lb_policy, Probe* probe) {
+        ReplayResult result;
+        const Integer npframe = trace.get_npframe(), nb_iterations = npframe * trace.get_nframes();
+        Integer lb_iteration = -1;
+        Time comp_time = 0;
+        for (Integer it = 0; it < nb_iterations; ++it) {
+            const auto record = trace.find_iteration(it, lb_iteration);
+            if (!record) break;
+            const auto& t = record->times;
+            probe->set_iteration_times(*std::max_element(t.cbegin(), t.cend()), *std::min_element(t.cbegin(), t.cend()),
+                                       std::accumulate(t.cbegin(), t.cend(), 0.0));
+            probe->update_cumulative_imbalance_time();
+            Time it_compute_time = probe->get_max_it();
+
+            if (probe->is_balanced()) probe->update_lb_parallel_efficiencies();
+
+            bool lb_decision = lb_policy.should_load_balance();
+            result.cum_li_hist.push_back(probe->get_cumulative_imbalance_time());
+
+            if (lb_decision) {
+                if (const auto lb = trace.find_load_balancing(it, lb_iteration)) {
+                    const Time lb_time = *std::max_element(lb->cbegin(), lb->cend());
+                    probe->push_load_balancing_time(lb_time);
+                    probe->reset_cumulative_imbalance_time();
+                    it_compute_time += lb_time;
+                    lb_iteration = it;
+                } else {
+                    result.nb_unavailable++;
+                    lb_decision = false;
+                }
+            }
+            result.decisions.push_back(lb_decision);
+            probe->set_balanced(lb_decision);
+
+            result.total_time += it_compute_time;
+            result.time_hist.push_back(result.total_time);
+            comp_time += it_compute_time;
+            probe->next_iteration();
+            result.nb_iterations++;
+            if ((it + 1) % npframe == 0) {
+                probe->batch_time = comp_time;
+                comp_time = 0;
+            }
+        }
+        return result;
+    }
+}
+#endif //NBMPI_TRACE_HPP
@@ -21,6 +21,7 @@
 template<class T>
 struct MESH_DATA {
     std::vector<T> els;
+    std::vector<float> weights; // load balancing weight of each element of els, empty: every element weighs 1
 };
 
 using Real       = float;
@@ -175,6 +176,7 @@ public:
     Time  compute_avg_lb_time() { return lb_times.size() == 0 ? 0.0 : std::accumulate(lb_times.cbegin(), lb_times.cend(), 0.0) / lb_times.size(); }
     Time* max_it_time() { return &max_it; }
     Time* min_it_time() { return &min_it; }
+    void  set_iteration_times(Time max, Time min, Time sum) { max_it = max; min_it = min; sum_it = sum; }
 
     void set_balanced(bool lb_status) {
         Probe::balanced = lb_status;
@@ -223,6 +225,26 @@ public:
         str << lb_times;
         return str.str();
     }
+
+    /* flat copy of the state of the probe, to send it to another process */
+    std::vector<double> pack() const {
+        std::vector<double> buf {(double) current_iteration, max_it, min_it, sum_it, cumulative_imbalance_time,
+                                 (double) balanced, (double) i, (double) nproc, batch_time,
+                                 (double) lb_times.size(), (double) lb_parallel_efficiencies.size()};
+        buf.insert(buf.end(), lb_times.cbegin(), lb_times.cend());
+        buf.insert(buf.end(), lb_parallel_efficiencies.cbegin(), lb_parallel_efficiencies.cend());
+        return buf;
+    }
+
+    void unpack(const double* buf) {
+        current_iteration = (int) buf[0];
+        max_it = buf[1]; min_it = buf[2]; sum_it = buf[3]; cumulative_imbalance_time = buf[4];
+        balanced = buf[5] != 0.0; i = (int) buf[6]; nproc = (int) buf[7]; batch_time = buf[8];
+        const size_t n_times = buf[9], n_efficiencies = buf[10];
+        buf += 11;
+        lb_times.assign(buf, buf + n_times);
+        lb_parallel_efficiencies.assign(buf + n_times, buf + n_times + n_efficiencies);
+    }
 };
 
 template<typename T>
@@ -614,14 +636,16 @@ namespace algorithm {
 
     constexpr Integer EMPTY = -1;
 
+    /* bin the spans into the existing lists, the first element gets the index first */
     template<int N, class T, class GetPositionFunc>
     void CLL_update(std::initializer_list<std::pair<T*, size_t>>&& elements,
                     GetPositionFunc getPositionFunc,
                     const BoundingBox<N>& bbox, Real rc,
                     std::vector<Integer> *head,
-                    std::vector<Integer> *lscl) {
+                    std::vector<Integer> *lscl,
+                    Integer first = 0) {
         auto lc = get_cell_number_by_dimension<N>(bbox, rc);
-        Integer c, acc = 0;
+        Integer c, acc = first;
         for(const auto& span : elements){
             auto el_ptr = span.first;
             auto n_els  = span.second;
@@ -651,45 +675,47 @@ namespace algorithm {
         head->at(cell) = i;
     }
 
-    template<class T, class GetPositionFunc, class ComputeForceFunc>
-    Integer CLL_compute_forces3d(std::vector<Real>* acc,
-                                 const T *elements, Integer n_elements,
-                                 const T *remote_elements,
-                                 GetPositionFunc getPosFunc,
-                                 const BoundingBox<3>& bbox, Real rc,
-                                 const std::vector<Integer> *head, const std::vector<Integer> *lscl,
-                                 ComputeForceFunc computeForceFunc) {
+    /**
+     * Accumulates in acc the force exerted on the local elements [i_begin, i_end) by their 27 neighbouring cells.
+     * Only the slots of these receivers are written, acc is not cleared.
+     * @param cells cell lists of the elements then the remote elements (see CellLists)
+     * @return the number of interactions computed
+     */
+    template<class T, class G, class GetPositionFunc, class Cells, class ComputeForceFunc>
+    Integer CLL_compute_forces3d_range(Real* acc,
+                                       const T *elements, Integer n_elements,
+                                       const G *remote_elements,
+                                       GetPositionFunc getPosFunc,
+                                       const BoundingBox<3>& bbox, Real rc,
+                                       const Cells *cells,
+                                       ComputeForceFunc computeForceFunc,
+                                       Integer i_begin, Integer i_end) {
         auto lc = get_cell_number_by_dimension<3>(bbox, rc);
-        std::array<Real, 3> delta_dim;
-        Real delta;
-        Integer c, c1, ic[3], ic1[3], j;
-        T source, receiver;
-        Integer cmplx = n_elements;
-        std::fill(acc->begin(), acc->begin()+n_elements, (Real) 0.0);
-        for (size_t i = 0; i < n_elements; ++i) {
+        Integer c, c1, ic[3], ic1[3];
+        Integer cmplx = 0;
+        for (Integer i = i_begin; i < i_end; ++i) {
             const auto& pos = *getPosFunc(const_cast<T&>(elements[i]));
             c = position_to_local_cell_index<3>(pos, rc, bbox, lc[0], lc[1]);
-            receiver = elements[i];
-            for (auto d = 0; d < 3; ++d)
-                ic[d] = c / lc[d];
-            for (ic1[0] = ic[0] - 1; ic1[0] < (ic[0]+1); ic1[0]++) {
-                for (ic1[1] = ic[1] - 1; ic1[1] < ic[1] + 1; ic1[1]++) {
-                    for (ic1[2] = ic[2] - 1; ic1[2] < ic[2] + 1; ic1[2]++) {
+            const T& receiver = elements[i];
+            ic[0] = c % lc[0];
+            ic[1] = (c / lc[0]) % lc[1];
+            ic[2] = c / (lc[0] * lc[1]);
+            for (ic1[0] = ic[0] - 1; ic1[0] <= ic[0] + 1; ic1[0]++) {
+                for (ic1[1] = ic[1] - 1; ic1[1] <= ic[1] + 1; ic1[1]++) {
+                    for (ic1[2] = ic[2] - 1; ic1[2] <= ic[2] + 1; ic1[2]++) {
                         /* this is for bounce back, to avoid heap-buffer over/under flow */
                         if((ic1[0] < 0 || ic1[0] >= lc[0]) || (ic1[1] < 0 || ic1[1] >= lc[1]) || (ic1[2] < 0 || ic1[2] >= lc[2])) continue;
                         c1 = (ic1[0]) + (lc[0] * ic1[1]) + (lc[0] * lc[1] * ic1[2]);
-                        j = head->at(c1);
-                        while(j != EMPTY) {
-                            if(i < j) {
-                                source = j < n_elements ? elements[j] : remote_elements[j - n_elements];
-                                std::array<Real, 3> force = computeForceFunc(receiver, source);
+                        cells->for_each(c1, [&](Integer j) {
+                            if(i != j) {
+                                std::array<Real, 3> force = j < n_elements ? computeForceFunc(receiver, elements[j])
+                                                                           : computeForceFunc(receiver, remote_elements[j - n_elements]);
                                 for (int dim = 0; dim < 3; ++dim) {
-                                    acc->at(3*i + dim) += force[dim];
+                                    acc[3*i + dim] += force[dim];
                                 }
                                 cmplx++;
                             }
-                            j = lscl->at(j);
-                        }
+                        });
                     }
                 }
             }
@@ -697,16 +723,29 @@ namespace algorithm {
         return cmplx;
     }
 
-    template<int N, class T, class GetPositionFunc, class ComputeForceFunc>
+    template<class T, class G, class GetPositionFunc, class Cells, class ComputeForceFunc>
+    Integer CLL_compute_forces3d(std::vector<Real>* acc,
+                                 const T *elements, Integer n_elements,
+                                 const G *remote_elements,
+                                 GetPositionFunc getPosFunc,
+                                 const BoundingBox<3>& bbox, Real rc,
+                                 const Cells *cells,
+                                 ComputeForceFunc computeForceFunc) {
+        std::fill(acc->begin(), acc->begin() + 3 * n_elements, (Real) 0.0);
+        return n_elements + CLL_compute_forces3d_range(acc->data(), elements, n_elements, remote_elements, getPosFunc,
+                                                       bbox, rc, cells, computeForceFunc, 0, n_elements);
+    }
+
+    template<int N, class T, class G, class GetPositionFunc, class Cells, class ComputeForceFunc>
     Integer CLL_compute_forces(std::vector<Real>* acc,
                                const std::vector<T>& loc_el,
-                               const std::vector<T>& rem_el,
+                               const std::vector<G>& rem_el,
                                GetPositionFunc getPosFunc,
                                const BoundingBox<N>& bbox, Real rc,
-                               const std::vector<Integer> *head, const std::vector<Integer> *lscl,
+                               const Cells *cells,
                                ComputeForceFunc computeForceFunc) {
         if constexpr(N==3) {
-            return CLL_compute_forces3d(acc, loc_el.data(), loc_el.size(), rem_el.data(), getPosFunc, bbox, rc, head, lscl, computeForceFunc);
+            return CLL_compute_forces3d(acc, loc_el.data(), loc_el.size(), rem_el.data(), getPosFunc, bbox, rc, cells, computeForceFunc);
         }else {
             return 0;
         }
@@ -0,0 +1,192 @@
+//
+// Created by xetql on 10/17/26.
+//
+
+#ifndef NBMPI_VERLET_LIST_HPP
+#define NBMPI_VERLET_LIST_HPP
+
+#include "utils.hpp"
+#include "force_kernels.hpp"
+
+#include <mpi.h>
+#include <vector>
+
+namespace algorithm {
+
+    /**
+     * Half Verlet neighbour list built on top of the cell lists. Every pair closer than cut-off + skin is stored
+     * once (own cell + half-shell stencil); pairs between two ghosts are not stored. The list stays valid as long
+     * as no particle moved more than skin/2 since the build and the local/ghost layout is unchanged.
+     */
+    template<int N>
+    class VerletList {
+        Real skin;
+        bool built = false;
+        Integer n_local = 0, n_total = 0;
+        std::vector<Integer> offsets, neighbors;
+        std::vector<Real> reference_positions;
+        ForceWorkspace workspace; // the lanes and force buffers of the threads
+    public:
+        explicit VerletList(Real skin) : skin(skin) {}
+
+        Real get_skin() const { return skin; }
+        bool is_built() const { return built; }
+        void invalidate() { built = false; }
+        Integer size() const { return neighbors.size(); }
+
+        /**
+         * @param positionOf j -> position of the j-th particle of the cell lists (locals first, then ghosts)
+         */
+        template<class PositionOf>
+        void build(Integer n_elements, Integer n_remote_elements,
+                   PositionOf positionOf,
+                   const BoundingBox<N>& bbox, Real rc,
+                   const CellLists<N> *cells,
+                   Real cut_off) {
+            static_assert(N == 3, "Verlet lists are only implemented in 3D");
+            const auto lc = get_cell_number_by_dimension<N>(bbox, rc);
+            const Integer n_cells = lc[0] * lc[1] * lc[2];
+            const Real r2_max = (cut_off + skin) * (cut_off + skin);
+
+            n_local = n_elements;
+            n_total = n_elements + n_remote_elements;
+            neighbors.clear();
+            std::vector<std::vector<Integer>> by_receiver(n_total);
+
+            auto consider = [&](Integer i, Integer j) {
+                if (i >= n_elements && j >= n_elements) return;
+                const auto& pi = positionOf(i);
+                const auto& pj = positionOf(j);
+                const Real dx = pi[0] - pj[0], dy = pi[1] - pj[1], dz = pi[2] - pj[2];
+                if (dx*dx + dy*dy + dz*dz < r2_max) by_receiver[i].push_back(j);
+            };
+
+            for (Integer c = 0; c < n_cells; ++c) {
+                if (cells->empty(c)) continue;
+                const Integer cx = c % lc[0], cy = (c / lc[0]) % lc[1], cz = c / (lc[0] * lc[1]);
+                cells->for_each_pair(c, consider);
+                cells->for_each(c, [&](Integer i) {
+                    for_each_half_shell_cell(cx, cy, cz, lc, [&](Integer c1) {
+                        cells->for_each(c1, [&](Integer j) { consider(i, j); });
+                    });
+                });
+            }
+
+            offsets.assign(n_total + 1, 0);
+            for (Integer i = 0; i < n_total; ++i) offsets[i + 1] = offsets[i] + by_receiver[i].size();
+            neighbors.reserve(offsets[n_total]);
+            for (const auto& nbrs : by_receiver) neighbors.insert(neighbors.end(), nbrs.cbegin(), nbrs.cend());
+
+            reference_positions.resize(N * n_elements);
+            for (Integer i = 0; i < n_elements; ++i) {
+                const auto& pos = positionOf(i);
+                for (int dim = 0; dim < N; ++dim) reference_positions[N*i + dim] = pos[dim];
+            }
+            built = true;
+        }
+
+        template<class T, class G, class GetPositionFunc>
+        void build(const T *elements, Integer n_elements,
+                   const G *remote_elements, Integer n_remote_elements,
+                   GetPositionFunc getPosFunc,
+                   const BoundingBox<N>& bbox, Real rc,
+                   const CellLists<N> *cells,
+                   Real cut_off) {
+            build(n_elements, n_remote_elements, [&](Integer j) -> const std::array<Real, 3>& {
+                return get_position3d(elements, n_elements, remote_elements, j, getPosFunc);
+            }, bbox, rc, cells, cut_off);
+        }
+
+        void build(const elements::ParticleStore<N>& store, Integer n_elements,
+                   const BoundingBox<N>& bbox, Real rc,
+                   const CellLists<N> *cells,
+                   Real cut_off) {
+            build(n_elements, store.size() - n_elements, [&store](Integer j) { return store.position(j); },
+                  bbox, rc, cells, cut_off);
+        }
+
+        /**
+         * Lennard-Jones forces from the list, +F to the receiver and -F to the source (local side only).
+         * The receivers are split among nb_threads threads, each one accumulating in its own force buffer.
+         * @return the number of interactions computed plus the number of local elements
+         */
+        template<class PositionOf>
+        Integer compute_forces(std::vector<Real>* acc, PositionOf positionOf, Real eps, Real sig2, int nb_threads) {
+            const auto lj_pair_forces = simd::get_lj_pair_forces();
+            auto& lanes = workspace.thread_lanes;
+            if (lanes.size() < (size_t) std::max(1, nb_threads)) lanes.resize(std::max(1, nb_threads));
+
+            auto receivers = [&](int tid, Real* a, Integer i_begin, Integer i_end) {
+                auto& l = lanes[tid];
+                Integer cmplx = 0;
+                for (Integer i = i_begin; i < i_end; ++i) {
+                    const Integer first = offsets[i], n = offsets[i + 1] - first;
+                    if (!n) continue;
+                    l.j.assign(neighbors.cbegin() + first, neighbors.cbegin() + first + n);
+                    l.resize();
+                    for (Integer k = 0; k < n; ++k) {
+                        const auto& pos = positionOf(l.j[k]);
+                        l.x[k] = pos[0]; l.y[k] = pos[1]; l.z[k] = pos[2];
+                    }
+                    const auto& pos = positionOf(i);
+                    lj_pair_forces(pos[0], pos[1], pos[2], l.x.data(), l.y.data(), l.z.data(), n, eps, sig2,
+                                   l.fx.data(), l.fy.data(), l.fz.data());
+                    Real fx = 0, fy = 0, fz = 0;
+                    for (Integer k = 0; k < n; ++k) {
+                        fx += l.fx[k]; fy += l.fy[k]; fz += l.fz[k];
+                        if (const Integer j = l.j[k]; j < n_local) {
+                            a[3*j]   -= l.fx[k];
+                            a[3*j+1] -= l.fy[k];
+                            a[3*j+2] -= l.fz[k];
+                        }
+                    }
+                    if (i < n_local) {
+                        a[3*i]   += fx;
+                        a[3*i+1] += fy;
+                        a[3*i+2] += fz;
+                    }
+                    cmplx += n;
+                }
+                return cmplx;
+            };
+            return n_local + parallel_accumulate_forces(acc, 3 * n_local, n_total, nb_threads, false, receivers, nullptr, &workspace);
+        }
+
+        template<class T, class G, class GetPositionFunc>
+        Integer compute_forces(std::vector<Real>* acc,
+                               const T *elements, const G *remote_elements,
+                               GetPositionFunc getPosFunc,
+                               Real eps, Real sig2, int nb_threads = 1) {
+            return compute_forces(acc, [&](Integer j) -> const std::array<Real, 3>& {
+                return get_position3d(elements, n_local, remote_elements, j, getPosFunc);
+            }, eps, sig2, nb_threads);
+        }
+
+        Integer compute_forces(std::vector<Real>* acc, const elements::ParticleStore<N>& store,
+                               Real eps, Real sig2, int nb_threads = 1) {
+            return compute_forces(acc, [&store](Integer j) { return store.position(j); }, eps, sig2, nb_threads);
+        }
+
+        /**
+         * Collective: true on every rank when a particle of any rank moved more than skin/2 since the last build.
+         */
+        template<class T, class GetPositionFunc>
+        bool needs_rebuild(const std::vector<T>& elements, GetPositionFunc getPosFunc, MPI_Comm comm) const {
+            double max_displacement2 = built ? 0.0 : std::numeric_limits<double>::max();
+            if (built) {
+                for (Integer i = 0; i < n_local; ++i) {
+                    const auto& pos = *getPosFunc(const_cast<T&>(elements[i]));
+                    double d2 = 0.0;
+                    for (int dim = 0; dim < N; ++dim) {
+                        const double d = pos[dim] - reference_positions[N*i + dim];
+                        d2 += d * d;
+                    }
+                    max_displacement2 = std::max(max_displacement2, d2);
+                }
+            }
+            MPI_Allreduce(MPI_IN_PLACE, &max_displacement2, 1, MPI_DOUBLE, MPI_MAX, comm);
+            return max_displacement2 > 0.25 * skin * skin;
+        }
+    };
+}
+#endif //NBMPI_VERLET_LIST_HPP
@@ -14,7 +14,6 @@
 #include <string>
 #include <vector>
 #include <zoltan.h>
-#include <set>
 
 #define ENABLE_AUTOMATIC_MIGRATION true
 
@@ -34,12 +33,14 @@ void get_object_list(void *data, int sizeGID, int sizeLID,
     size_t i;
     auto mesh= (MESH_DATA<elements::Element<N>> *)data;
     *ierr = ZOLTAN_OK;
-    /* In this example, return the IDs of our objects, but no weights.
-     * Zoltan will assume equally weighted objects.
+    /* Return the IDs of our objects and their weights if they were computed for the current elements,
+     * otherwise the objects are equally weighted.
      */
+    const bool weighted = mesh->weights.size() == mesh->els.size();
     for (i=0; i < mesh->els.size(); i++){
         globalID[i] = mesh->els[i].gid;
         localID[i] = i;
+        if(wgt_dim > 0) obj_wgts[i] = weighted ? mesh->weights[i] : 1.0f;
     }
 }
 template<int N>
@@ -83,7 +84,7 @@ Zoltan_Struct* zoltan_create_wrapper(MPI_Comm comm) {
     Zoltan_Set_Param(zz, "NUM_GID_ENTRIES", "1");
 
     Zoltan_Set_Param(zz, "NUM_LID_ENTRIES", "1");
-    Zoltan_Set_Param(zz, "OBJ_WEIGHT_DIM", "0");
+    Zoltan_Set_Param(zz, "OBJ_WEIGHT_DIM", "1");
     Zoltan_Set_Param(zz, "RETURN_LISTS", "ALL");
 
     Zoltan_Set_Param(zz, "RCB_OUTPUT_LEVEL", "0");
@@ -95,6 +96,7 @@ Zoltan_Struct* zoltan_create_wrapper(MPI_Comm comm) {
     return zz;
 }
 
+/* an element travels as it is: gid, lid, position and velocity */
 template<int N>
 int cpt_obj_size( void *data,
                   int num_gid_entries,
@@ -102,38 +104,60 @@ int cpt_obj_size( void *data,
                   ZOLTAN_ID_PTR global_id,
                   ZOLTAN_ID_PTR local_id,
                   int *ierr) {
-    ierr = ZOLTAN_OK;
-    return sizeof(int) * 2 + sizeof(Real) * N * 3 /*pos, vel, acc*/;
+    *ierr = ZOLTAN_OK;
+    return sizeof(elements::Element<N>);
 }
 
 template<int N>
-void pack_particles(void *data,
-                    int num_gid_entries,
-                    int num_lid_entries,
-                    ZOLTAN_ID_PTR global_id,
-                    ZOLTAN_ID_PTR local_id,
-                    int dest,
-                    int size,
-                    char *buf,
-                    int *ierr) {
-    auto all_mesh_data = (MESH_DATA<elements::Element<N>>*) data;
-    memcpy(buf, &(all_mesh_data->els[(int)(*local_id)]), sizeof(class elements::Element<N>));
-    all_mesh_data->els[(int)(*local_id)].gid = -1;
+void cpt_obj_size_multi(void * /* data */,
+                        int /* num_gid_entries */,
+                        int /* num_lid_entries */,
+                        int num_ids,
+                        ZOLTAN_ID_PTR /* global_ids */,
+                        ZOLTAN_ID_PTR /* local_ids */,
+                        int *sizes,
+                        int *ierr) {
+    std::fill(sizes, sizes + num_ids, (int) sizeof(elements::Element<N>));
+    *ierr = ZOLTAN_OK;
 }
 
+/* the exported elements stay in place until post_migrate_particles, each one is copied at the offset Zoltan gives */
 template<int N>
-void unpack_particles ( void *data,
-                        int num_gid_entries,
-                        ZOLTAN_ID_PTR global_id,
-                        int size,
-                        char *buf,
-                        int *ierr) {
-    auto all_mesh_data = (MESH_DATA<elements::Element<N>>*) data;
-    elements::Element<N> e;
-    memcpy(&e, buf, /*gid, lid*/ sizeof(Integer) * 2 + /*position[x,y,(z)], velocity[x,y,(z)]*/sizeof(Real) * N * 2);
-    all_mesh_data->els.push_back(e);
+void pack_particles_multi(void *data,
+                          int /* num_gid_entries */,
+                          int /* num_lid_entries */,
+                          int num_ids,
+                          ZOLTAN_ID_PTR /* global_ids */,
+                          ZOLTAN_ID_PTR local_ids,
+                          int * /* dest */,
+                          int * /* sizes */,
+                          int *idx,
+                          char *buf,
+                          int *ierr) {
+    using Element = elements::Element<N>;
+    const auto& els = ((MESH_DATA<Element>*) data)->els;
+    for (int i = 0; i < num_ids; ++i) memcpy(buf + idx[i], &els[local_ids[i]], sizeof(Element));
+    *ierr = ZOLTAN_OK;
+}
+
+template<int N>
+void unpack_particles_multi(void *data,
+                            int /* num_gid_entries */,
+                            int num_ids,
+                            ZOLTAN_ID_PTR /* global_ids */,
+                            int * /* sizes */,
+                            int *idx,
+                            char *buf,
+                            int *ierr) {
+    using Element = elements::Element<N>;
+    auto& els = ((MESH_DATA<Element>*) data)->els;
+    const size_t offset = els.size();
+    els.resize(offset + num_ids);
+    for (int i = 0; i < num_ids; ++i) memcpy(&els[offset + i], buf + idx[i], sizeof(Element));
+    *ierr = ZOLTAN_OK;
 }
 
+/* remove the exported elements in one stable pass, the local order of the others is kept, and number them again */
 template<int N>
 void post_migrate_particles (
         void *data,
@@ -142,22 +166,18 @@ void post_migrate_particles (
         int *import_procs, int num_export,
         ZOLTAN_ID_PTR export_global_ids, ZOLTAN_ID_PTR export_local_ids,
         int *export_procs, int *ierr) {
-    auto all_mesh_data = (MESH_DATA<elements::Element<N>>*) data;
-    size_t size = all_mesh_data->els.size();
-    size_t i = 0;
-    while(i < size) {
-        if(all_mesh_data->els[i].gid == -1){
-            std::iter_swap(all_mesh_data->els.begin() + i, all_mesh_data->els.end() - 1);
-            all_mesh_data->els.pop_back();
-            size--;
-        } else {
-            i++;
-        }
-    }
-    size = all_mesh_data->els.size();
-    for(size_t i = 0; i < size; i++){
-        all_mesh_data->els[i].lid = i;
+    auto& els = ((MESH_DATA<elements::Element<N>>*) data)->els;
+    std::vector<bool> exported(els.size(), false);
+    for (int i = 0; i < num_export; ++i) exported[export_local_ids[i]] = true;
+    size_t kept = 0;
+    for (size_t i = 0; i < els.size(); ++i) {
+        if (exported[i]) continue;
+        if (kept != i) els[kept] = els[i];
+        els[kept].lid = kept;
+        kept++;
     }
+    els.resize(kept);
+    *ierr = ZOLTAN_OK;
 }
 
 template<int N>
@@ -167,247 +187,27 @@ void zoltan_fn_init(Zoltan_Struct* zz, MESH_DATA<elements::Element<N>>* mesh_dat
     Zoltan_Set_Num_Geom_Fn(  zz, get_num_geometry<N>,      mesh_data);
     Zoltan_Set_Geom_Multi_Fn(zz, get_geometry_list<N>,     mesh_data);
     Zoltan_Set_Obj_Size_Fn(zz, cpt_obj_size<N>, mesh_data);
-    Zoltan_Set_Pack_Obj_Fn(zz, pack_particles<N>, mesh_data);
-    Zoltan_Set_Unpack_Obj_Fn(zz, unpack_particles<N>, mesh_data);
+    Zoltan_Set_Obj_Size_Multi_Fn(zz, cpt_obj_size_multi<N>, mesh_data);
+    Zoltan_Set_Pack_Obj_Multi_Fn(zz, pack_particles_multi<N>, mesh_data);
+    Zoltan_Set_Unpack_Obj_Multi_Fn(zz, unpack_particles_multi<N>, mesh_data);
     Zoltan_Set_Post_Migrate_Fn(zz, post_migrate_particles<N>, mesh_data);
 }
 
-template<int N>
-typename std::vector<elements::Element<N>>::const_iterator zoltan_migrate_particles(
-        std::vector<elements::Element<N>> &data,
-        Zoltan_Struct *load_balancer,
-        const Integer* head,
-        const Integer* lscl,
-        const Borders& bordering_cells,
-        MPI_Datatype datatype,
-        MPI_Comm LB_COMM)
-{
-
-    int wsize;
-    MPI_Comm_size(LB_COMM, &wsize);
-    int caller_rank;
-    MPI_Comm_rank(LB_COMM, &caller_rank);
-
-    if(wsize == 1) return data.cend();
-
-    auto nb_elements = data.size();
-    const auto prev_size = data.size();
-    std::vector< std::vector<elements::Element<N>> > data_to_migrate(wsize);
-    std::for_each(data_to_migrate.begin(), data_to_migrate.end(),
-                  [size = nb_elements, wsize](auto &buf) { buf.reserve(size / wsize); });
-    size_t data_id = 0;
-
-    int PE, num_known = 0;
-    ZOLTAN_ID_PTR found_gids, found_lids;
-    int *found_procs, *found_parts, num_found;
-
-    std::vector<int> export_gids, export_lids, export_procs;
-    int cell_cnt = 0;
-    for(auto cidx : bordering_cells.bordering_cells) {
-        auto p = head[cidx];
-        while(p != -1) {
-            num_known ++;
-            p = lscl[p];
-        }
-        cell_cnt++;
-    }
-    export_gids.reserve(num_known);
-    export_lids.reserve(num_known);
-    export_procs.reserve(num_known);
-    cell_cnt = 0;
-    num_known = 0;
-    for(auto cidx : bordering_cells.bordering_cells){
-        auto p = head[cidx];
-        while(p != -1) {
-            if(p < nb_elements) {
-                const elements::Element<N>& el = data.at(p);
-                auto pos_in_double = get_as_double_array<N>(el.position);
-                Zoltan_LB_Point_Assign(load_balancer, &pos_in_double.front(), &PE);
-                if(PE != caller_rank){
-                    export_gids.push_back(el.gid);
-                    export_lids.push_back(p);
-                    export_procs.push_back(PE);
-                    data_to_migrate.at(PE).push_back(el);
-                    num_known ++;
-                }
-            }
-            p = lscl[p];
-        }
-        cell_cnt++;
-    }
-    export_gids.shrink_to_fit();
-    export_lids.shrink_to_fit();
-    export_procs.shrink_to_fit();
-
-    std::sort(export_lids.begin(), export_lids.end(), std::greater<int>());
-
-    for(auto lid : export_lids) {
-        std::iter_swap(data.begin()+lid, data.end()-1);
-        data.pop_back();
-    }
-
-    ZOLTAN_ID_PTR known_gids = (ZOLTAN_ID_PTR) export_gids.data();
-    ZOLTAN_ID_PTR known_lids = (ZOLTAN_ID_PTR) export_lids.data();
-
-    Zoltan_Invert_Lists(load_balancer, export_procs.size(), known_gids, known_lids, export_procs.data(), export_procs.data(),
-                        &num_found, &found_gids, &found_lids, &found_procs, &found_parts);
-
-    data.reserve(data.size() + num_found);
-
-    std::set<int> import_from_procs(found_procs, found_procs+num_found);
-
-    /* Let's Migrate ma boi ! */
-    if(num_found)
-        Zoltan_LB_Free_Part(&found_gids, &found_lids, &found_procs, &found_parts);
-
-    int nb_reqs = std::count_if(data_to_migrate.cbegin(), data_to_migrate.cend(), [](const auto& buf){return !buf.empty();});
-
-    int cpt = 0;
-
-    std::vector<MPI_Request> reqs(nb_reqs);
-    for (size_t PE = 0; PE < wsize; PE++) {
-        int send_size = data_to_migrate.at(PE).size();
-        if (send_size) {
-            MPI_Isend(&data_to_migrate.at(PE).front(), send_size, datatype, PE, 300, LB_COMM, &reqs[cpt]);
-            cpt++;
-        }
-    }
-
-    std::vector<elements::Element<N>> buffer;
-
-    int recv_count = import_from_procs.size();
-    MPI_Status status;
-    int size;
-    while(recv_count) {
-        // Probe for next incoming message
-        MPI_Probe(MPI_ANY_SOURCE, 300, LB_COMM, &status);
-        // Get message size
-        MPI_Get_count(&status, datatype, &size);
-        // Resize buffer if needed
-        if(buffer.capacity() < size) buffer.reserve(size);
-        // Receive data
-        MPI_Recv(buffer.data(), size, datatype, status.MPI_SOURCE, 300, LB_COMM, MPI_STATUS_IGNORE);
-        // Move to my data
-        std::move(buffer.begin(), buffer.begin()+size, std::back_inserter(data));
-        // One less message to recover
-        recv_count--;
-    }
-
-    const int nb_data = data.size();
-    for(int i = 0; i < nb_data; ++i) data.at(i).lid = i;
-    data.shrink_to_fit();
-
-    MPI_Waitall(reqs.size(), &reqs.front(), MPI_STATUSES_IGNORE);
-    return std::next(data.cbegin(), nb_data - prev_size);
-}
-
-template<int N>
-typename std::vector<elements::Element<N>>::const_iterator Zoltan_Migrate_Particles(
-        std::vector<elements::Element<N>> &data,
-        Zoltan_Struct *load_balancer,
-        MPI_Datatype datatype,
-        MPI_Comm LB_COMM) {
-    int wsize;
-    MPI_Comm_size(LB_COMM, &wsize);
-    int caller_rank;
-    MPI_Comm_rank(LB_COMM, &caller_rank);
-    const auto prev_size = data.size();
-    if(wsize == 1) return data.cend();
-    auto nb_elements = data.size();
-
-    std::vector< std::vector<elements::Element<N>> > data_to_migrate(wsize);
-    std::for_each(data_to_migrate.begin(), data_to_migrate.end(),
-                  [size = nb_elements, wsize](auto &buf) { buf.reserve(size / wsize); });
-
-    size_t data_id = 0;
-    int PE, num_known = 0;
-    ZOLTAN_ID_PTR found_gids, found_lids;
-    int *found_procs, *found_parts, num_found;
-
-    {
-        std::vector<int> export_gids, export_lids, export_procs;
-        export_gids.reserve(nb_elements / wsize);
-        export_lids.reserve(nb_elements / wsize);
-        export_procs.reserve(nb_elements / wsize);
-
-        while (data_id < nb_elements) {
-            auto pos_in_double = get_as_double_array<N>(data.at(data_id).position);
-            Zoltan_LB_Point_Assign(load_balancer, &pos_in_double.front(), &PE);
-            if (PE != caller_rank) {
-                export_gids.push_back(data.at(data_id).gid);
-                export_lids.push_back(data.at(data_id).lid);
-                export_procs.push_back(PE);
-                //if the current element has to be moved, then swap with the last and pop it out (dont need to move the pointer also)
-                //swap iterator values in constant time
-                std::iter_swap(data.begin() + data_id, data.end() - 1);
-                //get the value and push it in the "to migrate" vector
-                data_to_migrate.at(PE).push_back(*(data.end() - 1));
-                //pop the head of the list in constant time
-                data.pop_back();
-                nb_elements--;
-                num_known++;
-            } else data_id++; //if the element must stay with me then check the next one
-        }
-         export_gids.shrink_to_fit();
-         export_lids.shrink_to_fit();
-        export_procs.shrink_to_fit();
-
-        ZOLTAN_ID_PTR known_gids = (ZOLTAN_ID_PTR) &export_gids.front();
-        ZOLTAN_ID_PTR known_lids = (ZOLTAN_ID_PTR) &export_lids.front();
-
-        Zoltan_Invert_Lists(load_balancer, num_known, known_gids, known_lids, &export_procs[0], &export_procs[0],
-                                       &num_found, &found_gids, &found_lids, &found_procs, &found_parts);
-    }
-
-    std::set<int> import_from_procs(found_procs, found_procs+num_found);
-
-    data.reserve(nb_elements + num_found);
-
-    /* Let's Migrate ma boi ! */
-
-    if(num_found > 0)
-        Zoltan_LB_Free_Part(&found_gids, &found_lids, &found_procs, &found_parts);
-
-    int nb_reqs = std::count_if(data_to_migrate.cbegin(), data_to_migrate.cend(), [](const auto& buf){return !buf.empty();});
-
-    int cpt = 0;
-
-    std::vector<MPI_Request> reqs(nb_reqs);
-    for (size_t PE = 0; PE < wsize; PE++) {
-        int send_size = data_to_migrate.at(PE).size();
-        if (send_size) {
-            MPI_Isend(&data_to_migrate.at(PE).front(), send_size, datatype, PE, 300, LB_COMM,
-                      &reqs[cpt]);
-            cpt++;
-        }
-    }
-
-    std::vector<elements::Element<N>> buffer;
-
-    int recv_count = import_from_procs.size();
-    MPI_Status status;
-    int size;
-    while(recv_count) {
-        // Probe for next incoming message
-        MPI_Probe(MPI_ANY_SOURCE, 300, LB_COMM, &status);
-        // Get message size
-        MPI_Get_count(&status, datatype, &size);
-        // Resize buffer if needed
-        if(buffer.capacity() < size) buffer.reserve(size);
-        // Receive data
-        MPI_Recv(buffer.data(), size, datatype, status.MPI_SOURCE, 300, LB_COMM, MPI_STATUS_IGNORE);
-        // Move to my data
-        std::move(buffer.begin(), buffer.begin()+size, std::back_inserter(data));
-        // One less message to recover
-        recv_count--;
-    }
-
-    const int nb_data = data.size();
-    for(int i = 0; i < nb_data; ++i) data[i].lid = i;
-
-    MPI_Waitall(reqs.size(), &reqs.front(), MPI_STATUSES_IGNORE);
+/* compute the partition of the elements into load_balancer without moving them */
+template <int N>
+void Zoltan_Compute_Partition(MESH_DATA<elements::Element<N>>* mesh_data, Zoltan_Struct* load_balancer) {
+    int changes, numGidEntries, numLidEntries, numImport, numExport;
+    ZOLTAN_ID_PTR importGlobalGids, importLocalGids, exportGlobalGids, exportLocalGids;
+    int *importProcs, *importToPart, *exportProcs, *exportToPart;
 
-    return std::next(data.begin(), nb_data - prev_size);
+    zoltan_fn_init(load_balancer, mesh_data);
+    Zoltan_Set_Param(load_balancer, "AUTO_MIGRATE", "FALSE");
+    Zoltan_LB_Partition(load_balancer, &changes, &numGidEntries, &numLidEntries,
+                        &numImport, &importGlobalGids, &importLocalGids, &importProcs, &importToPart,
+                        &numExport, &exportGlobalGids, &exportLocalGids, &exportProcs, &exportToPart);
+    Zoltan_LB_Free_Part(&importGlobalGids, &importLocalGids, &importProcs, &importToPart);
+    Zoltan_LB_Free_Part(&exportGlobalGids, &exportLocalGids, &exportProcs, &exportToPart);
+    Zoltan_Set_Param(load_balancer, "AUTO_MIGRATE", "TRUE");
 }
 
 template <int N>
@@ -437,5 +237,7 @@ void Zoltan_Do_LB(MESH_DATA<elements::Element<N>>* mesh_data, Zoltan_Struct* loa
     Zoltan_LB_Free_Part(&importGlobalGids, &importLocalGids, &importProcs, &importToPart);
     Zoltan_LB_Free_Part(&exportGlobalGids, &exportLocalGids, &exportProcs, &exportToPart);
 
+    // the elements have been migrated, the weights do not match them anymore
+    mesh_data->weights.clear();
 }
 #endif //NBMPI_ZOLTAN_FN_HPP
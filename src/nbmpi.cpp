@@ -14,8 +14,9 @@ int main(int argc, char** argv) {
     float ver;
     MESH_DATA<elements::Element<N>> mesh_data;
 
-    // Initialize the MPI environment
-    MPI_Init(&argc, &argv);
+    // Initialize the MPI environment, worker threads never call MPI
+    int thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &nproc);
     MPI_Comm APP_COMM;
@@ -29,11 +30,37 @@ int main(int argc, char** argv) {
     auto params = option.value();
 
     params.world_size = nproc;
+    if(params.nb_best_path && (params.astar_groups < 1 || params.astar_groups > 2 || nproc % params.astar_groups)) {
+        if(!rank) std::cout << "A* groups: only 1 or 2 groups of the same size are supported" << std::endl;
+        MPI_Finalize();
+        exit(EXIT_FAILURE);
+    }
     params.simsize = std::ceil(params.simsize / params.rc) * params.rc;
+    // Neighbours within cut-off + skin must lie in the adjacent cells (and in the halo)
+    if(const Real max_skin = params.rc - 2.5f * params.sig_lj; params.verlet_skin > max_skin) {
+        if(!rank) std::cout << "Verlet skin " << params.verlet_skin << " does not fit in the lattice, using " << std::max((Real) 0.0, max_skin) << std::endl;
+        params.verlet_skin = std::max((Real) 0.0, max_skin);
+    }
+    params.nb_threads = std::max(1, params.nb_threads);
+    if(thread_support < MPI_THREAD_FUNNELED && params.nb_threads > 1) {
+        if(!rank) std::cout << "MPI library does not support MPI_THREAD_FUNNELED, using 1 thread per process" << std::endl;
+        params.nb_threads = 1;
+    }
     MPI_Bcast(&params.seed, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
+    const auto policies = decision_making::PolicySpec::parse_list(params.policies);
+    for (const auto& spec : policies) {
+        if (const auto error = decision_making::get_policy_registry().validate(spec); !error.empty()) {
+            if(!rank) std::cout << error << std::endl;
+            MPI_Finalize();
+            exit(EXIT_FAILURE);
+        }
+    }
+
     if (rank == 0) {
         print_params(params);
+        if(params.force_kernel == BatchedLJKernel)
+            std::cout << "Batched LJ kernel ISA: " << algorithm::simd::to_string(algorithm::simd::get_isa()) << std::endl;
     }
 
     if(Zoltan_Initialize(argc, argv, &ver) != ZOLTAN_OK) {
@@ -155,15 +182,17 @@ int main(int argc, char** argv) {
 
     auto zlb = Zoltan_Copy(zz);
 
-    auto boxIntersectFunc   = [](Zoltan_Struct* zlb, double x1, double y1, double z1, double x2, double y2, double z2, int* PEs, int* num_found){
-        Zoltan_LB_Box_Assign(zlb, x1, y1, z1, x2, y2, z2, PEs, num_found);
+    // with a Zoltan load balancer or the cuts of one (partitioning::CutTree)
+    auto boxIntersectFunc   = [](auto* zlb, double x1, double y1, double z1, double x2, double y2, double z2, int* PEs, int* num_found){
+        box_assign(zlb, x1, y1, z1, x2, y2, z2, PEs, num_found);
     };
-    auto pointAssignFunc    = [](Zoltan_Struct* zlb, const elements::Element<N>& e, int* PE) {
+    auto pointAssignFunc    = [](auto* zlb, const elements::Element<N>& e, int* PE) {
         auto pos_in_double = get_as_double_array<N>(e.position);
-        Zoltan_LB_Point_Assign(zlb, &pos_in_double.front(), PE);
+        point_assign(zlb, &pos_in_double.front(), PE);
     };
     auto doLoadBalancingFunc= [](Zoltan_Struct* zlb, MESH_DATA<elements::Element<N>>* mesh_data){ Zoltan_Do_LB(mesh_data, zlb); };
-    auto getPositionPtrFunc = [](elements::Element<N>& e) {
+    // elements and position-only ghosts (elements::Ghost<N>) alike
+    auto getPositionPtrFunc = [](auto& e) {
         return &e.position;
     };
     auto getVelocityPtrFunc = [](elements::Element<N>& e) { return &e.velocity; };
@@ -188,6 +217,9 @@ int main(int argc, char** argv) {
     auto datatype = elements::register_datatype<N>();
     std::string prefix = std::to_string(params.id)+"_"+std::to_string(params.seed);
 
+    // Per-iteration statistics of every run, for the offline evaluation of policies (replay)
+    trace::TraceRecorder recorder(params.trace_file, params, APP_COMM);
+
     /* Experiment 1 */
     double load_balancing_cost = 0;
     double load_balancing_parallel_efficiency = 0;
@@ -196,7 +228,8 @@ int main(int argc, char** argv) {
         mesh_data = original_data;
         Zoltan_Do_LB(&mesh_data, zlb);
         if(!rank) std::cout << "Branch and Bound: Computation is starting." << std::endl;
-        auto [solution, li, dec, thist] = simulate_using_shortest_path<N>(&mesh_data, zlb, fWrapper, &params, datatype, APP_COMM);
+        recorder.begin_run("astar");
+        auto [solution, li, dec, thist] = simulate_using_shortest_path<N>(&mesh_data, zlb, fWrapper, &params, datatype, APP_COMM, &recorder);
         if(!rank) {
             std::ofstream ofbab;
             ofbab.open(prefix+"_branch_and_bound.txt");
@@ -211,118 +244,33 @@ int main(int argc, char** argv) {
         load_balancing_parallel_efficiency = solution.back()->stats.compute_avg_lb_parallel_efficiency();
     }
 
-    // Do not use Zoltan_Copy(...) as it invalidates pointer, zlb must be valid throughout the entire program
-    Zoltan_Copy_To(zlb, zz);
-
-    {   /* Experiment 1 */
-
-        mesh_data = original_data;
-
-        Probe probe(nproc);
-        probe.push_load_balancing_time(load_balancing_cost);
-
-        Zoltan_Do_LB(&mesh_data, zlb);
-
-        if(!rank) {
-            std::cout << "SIM (Menon Criterion): Computation is starting." << std::endl;
-            std::cout << "Average C = " << probe.compute_avg_lb_time() << std::endl;
-        }
-
-        PolicyExecutor menon_criterion_policy(&probe,
-         [rank, npframe = params.npframe](Probe probe) {
-                bool is_new_batch = (probe.get_current_iteration() % npframe == 0);
-                bool is_cum_imb_higher_than_C = (probe.get_cumulative_imbalance_time() >= probe.compute_avg_lb_time());
-                return is_new_batch && is_cum_imb_higher_than_C;
-        });
-
-        auto [t, cum, dec, thist] = simulate<N>(zlb, &mesh_data, std::move(menon_criterion_policy), fWrapper, &params, &probe, datatype, APP_COMM, "menon_");
-
-        if(!rank) {
-            std::ofstream ofcri;
-            ofcri.open(prefix+"_criterion_menon.txt");
-            ofcri << std::fixed << std::setprecision(6) << t << std::endl;
-            ofcri << cum << std::endl;
-            ofcri << dec << std::endl;
-            ofcri << thist << std::endl;
-            ofcri << probe.lb_cost_to_string() << std::endl;
-
-            ofcri.close();
-        }
-
-    }
-
-    // Do not use Zoltan_Copy(...) as it invalidates pointer, zlb must be valid throughout the entire program
-    Zoltan_Copy_To(zlb, zz);
-
-    {   /* Experiment 3 */
+    // Run the requested policies one after the other, each from the initial data and partitioning
+    PolicyRegistry::Priors priors {load_balancing_cost, (Real) load_balancing_parallel_efficiency};
+    recorder.priors(priors);
+    bool zlb_used = params.nb_best_path > 0;
+    for (const auto& spec : policies) {
+        // Do not use Zoltan_Copy(...) as it invalidates pointer, zlb must be valid throughout the entire program
+        if (zlb_used) Zoltan_Copy_To(zlb, zz);
+        zlb_used = true;
 
         mesh_data = original_data;
 
         Probe probe(nproc);
-        probe.push_load_balancing_time(load_balancing_cost);
-        probe.push_load_balancing_parallel_efficiency(load_balancing_parallel_efficiency);
+        auto policy = get_policy_registry().make(spec, &probe, params, priors);
 
         Zoltan_Do_LB(&mesh_data, zlb);
 
         if(!rank) {
-            std::cout << "SIM (Procassini Criterion): Computation is starting." << std::endl;
+            std::cout << "SIM (" << spec.label() << " policy): Computation is starting." << std::endl;
             std::cout << "Average C = " << probe.compute_avg_lb_time() << std::endl;
         }
 
-        PolicyExecutor procassini_criterion_policy(&probe,
-        [npframe = params.npframe](Probe probe){
-                bool is_new_batch = (probe.get_current_iteration() % npframe == 0);
-                Real epsilon_c = probe.get_efficiency();
-                Real epsilon_lb= probe.compute_avg_lb_parallel_efficiency(); //estimation based on previous lb call
-                Real S         = epsilon_c / epsilon_lb;
-                Real tau_prime = probe.batch_time *  S + probe.compute_avg_lb_time(); //estimation of next iteration time based on speed up + LB cost
-                Real tau       = probe.batch_time;
-                return is_new_batch && (tau_prime < 0.9f * tau);
-            });
-
-        auto [t, cum, dec, thist] = simulate<N>(zlb, &mesh_data, std::move(procassini_criterion_policy), fWrapper, &params, &probe, datatype, APP_COMM, "procassini_");
-
-        if(!rank) {
-            std::ofstream ofcri;
-            ofcri.open(prefix+"_criterion_procassini.txt");
-            ofcri << std::fixed << std::setprecision(6) << t << std::endl;
-            ofcri << cum << std::endl;
-            ofcri << dec << std::endl;
-            ofcri << thist << std::endl;
-            ofcri << probe.lb_cost_to_string() << std::endl;
-            ofcri.close();
-        }
-    }
-
-    // Do not use Zoltan_Copy(...) as it invalidates pointer, zlb must be valid throughout the entire program
-    Zoltan_Copy_To(zlb, zz);
-
-    {   /* Experiment 4 */
-
-        mesh_data = original_data;
-
-        Probe probe(nproc);
-
-        Zoltan_Do_LB(&mesh_data, zlb);
-
-        if(!rank) {
-            std::cout << "SIM (Marquez Criterion): Computation is starting." << std::endl;
-        }
-
-        PolicyExecutor marquez_criterion_policy(&probe,
-            [rank, threshold = 0.1, npframe = params.npframe](Probe probe){
-                bool is_new_batch = (probe.get_current_iteration() % npframe == 0);
-                Real tolerance      = probe.get_avg_it() * threshold;
-                Real tolerance_plus = probe.get_avg_it() + tolerance;
-                Real tolerance_minus= probe.get_avg_it() - tolerance;
-                return is_new_batch && (probe.get_min_it() < tolerance_minus || tolerance_plus < probe.get_max_it());
-            });
-
-        auto [t, cum, dec, thist] = simulate<N>(zlb, &mesh_data, std::move(marquez_criterion_policy), fWrapper, &params, &probe, datatype, APP_COMM, "marquez_");
+        recorder.begin_run(spec.label());
+        auto [t, cum, dec, thist] = simulate<N>(zlb, &mesh_data, std::move(policy), fWrapper, &params, &probe, datatype, APP_COMM, spec.label()+"_", &recorder);
 
         if(!rank) {
             std::ofstream ofcri;
-            ofcri.open(prefix+"_criterion_marquez.txt");
+            ofcri.open(prefix+"_criterion_"+spec.label()+".txt");
             ofcri << std::fixed << std::setprecision(6) << t << std::endl;
             ofcri << cum << std::endl;
             ofcri << dec << std::endl;
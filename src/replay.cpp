@@ -0,0 +1,75 @@
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <random>
+
+#include "../includes/trace.hpp"
+
+/**
+ * Offline evaluation of load balancing policies: the policies are driven by the statistics of a trace recorded by
+ * nbmpi (--trace) instead of running the simulation again.
+ */
+int main(int argc, char** argv) {
+    using namespace decision_making;
+
+    sim_param_t params;
+    std::string trace_file, run;
+
+    zz::cfg::ArgParser parser;
+    parser.add_opt_help('h', "help");
+    parser.add_opt_value('i', "input", trace_file, std::string(), "Trace recorded with nbmpi --trace", "FILE").require();
+    parser.add_opt_value('r', "run", run, std::string(), "Run of the trace to replay (astar or a policy label), default: every run", "STRING");
+    parser.add_opt_value('P', "policy", params.policies, std::string("menon,procassini,marquez"), "Load balancing policies to evaluate, see nbmpi --policy", "STRING");
+    parser.add_opt_value('S', "seed", params.seed, 0, "Random seed of the stochastic policies", "INT");
+    parser.parse(argc, argv);
+
+    if (parser.count_error() > 0) {
+        std::cout << parser.get_error() << std::endl;
+        std::cout << parser.get_help() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto policies = PolicySpec::parse_list(params.policies);
+    for (const auto& spec : policies) {
+        if (const auto error = get_policy_registry().validate(spec); !error.empty()) {
+            std::cout << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const trace::Trace trace(trace_file, run);
+    params.world_size = trace.get_nproc();
+    params.npframe    = trace.get_npframe();
+    params.nframes    = trace.get_nframes();
+
+    const Integer nb_iterations = (Integer) params.npframe * params.nframes;
+    std::cout << "Trace: " << trace.get_nproc() << " PEs, " << params.nframes << "x" << params.npframe
+              << " iterations, " << trace.size() << " recorded states from";
+    if (run.empty()) for (const auto& label : trace.get_runs()) std::cout << ' ' << label;
+    else std::cout << ' ' << run;
+    std::cout << std::endl;
+
+    for (const auto& spec : policies) {
+        Probe probe(trace.get_nproc());
+        auto policy = get_policy_registry().make(spec, &probe, params, trace.get_priors());
+        const auto result = trace::replay(trace, policy, &probe);
+
+        std::cout << spec.label() << ": time " << std::fixed << std::setprecision(6) << result.total_time
+                  << ", load balancing calls " << std::count(result.decisions.cbegin(), result.decisions.cend(), 1)
+                  << ", iterations " << result.nb_iterations << "/" << nb_iterations;
+        if (result.nb_unavailable) std::cout << ", decisions not in the trace " << result.nb_unavailable;
+        std::cout << std::endl;
+
+        std::ofstream ofcri;
+        ofcri.open(trace_file + "_replay_" + spec.label() + ".txt");
+        ofcri << std::fixed << std::setprecision(6) << result.total_time << std::endl;
+        ofcri << result.cum_li_hist << std::endl;
+        ofcri << result.decisions << std::endl;
+        ofcri << result.time_hist << std::endl;
+        ofcri << probe.lb_cost_to_string() << std::endl;
+        ofcri.close();
+    }
+    return 0;
+}